@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+// a pool of Ts addressed by 32-bit indices.  allocation bumps a counter and
+// never blocks; items are only ever freed all at once.  index 0 is never
+// handed out, so that it can stand for none.
+template <typename T>
+class Arena {
+  std::vector<T> items;
+  std::atomic<uint32_t> m_size;
+
+public:
+  Arena(size_t capacity = 1)
+    : m_size(1)
+  {
+    resize(capacity);
+  }
+
+  // NOTE: discards all items
+  void resize(size_t capacity) {
+    capacity = std::max<size_t>(1, std::min<size_t>(capacity, std::numeric_limits<uint32_t>::max()));
+    std::vector<T>().swap(items);
+    items = std::vector<T>(capacity);
+    m_size = 1;
+  }
+
+  // NOTE: the caller must make sure that no one is using any of the items
+  inline void clear() { m_size = 1; }
+  // forget the items from index size on, e.g. after moving the ones in use
+  // to the front
+  // NOTE: the caller must make sure that no one is using any of those items
+  inline void truncate(size_t size) { m_size = std::max<size_t>(1, std::min(size, items.size())); }
+
+  inline size_t capacity() const { return items.size(); }
+  inline size_t size() const { return m_size; }
+
+  // the index of the first of n consecutive items, or 0 if there is no room
+  inline uint32_t allocate(uint32_t n = 1) {
+    uint32_t size = m_size.load(std::memory_order_relaxed);
+    do {
+      if (size + uint64_t(n) > items.size())
+        return 0;
+    } while (!m_size.compare_exchange_weak(size, size + n, std::memory_order_relaxed));
+    return size;
+  }
+
+  inline T&       operator[](uint32_t index)       { return items[index]; }
+  inline T const& operator[](uint32_t index) const { return items[index]; }
+};
@@ -4,6 +4,10 @@
 #include <cstdint>
 #include <functional>
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 #include <boost/random.hpp>
 
 #include "bitboard.hpp"
@@ -41,15 +45,24 @@ namespace bitboard {
     return __builtin_popcountll(b);
   }
 
-  inline size_t random_index(Bitboard b, boost::mt19937& generator) {
-    assert(!is_empty(b));
-    size_t n = cardinality(b);
-    boost::uniform_int<> distribution(0, n - 1);
-    size_t k = distribution(generator);
+  // index of the k-th (counting from zero) member of b
+  inline size_t nth_member(Bitboard b, size_t k) {
+    assert(k < cardinality(b));
+#ifdef __BMI2__
+    return scan_forward(_pdep_u64(Bitboard(1) << k, b));
+#else
     while (k > 0) {
       scan_forward_with_reset(b);
       --k;
     }
     return scan_forward(b);
+#endif
+  }
+
+  inline size_t random_index(Bitboard b, boost::mt19937& generator) {
+    assert(!is_empty(b));
+    size_t n = cardinality(b);
+    boost::uniform_int<> distribution(0, n - 1);
+    return nth_member(b, distribution(generator));
   }
 }
@@ -14,60 +14,31 @@ namespace castles {
 #undef CASTLES
   const size_t cardinality = sizeof(values) / sizeof(values[0]);
 
-  inline const Bitboard& safe_squares(Color color, Castle castle) {
+  // plain expressions rather than tables, so that they fold away when the
+  // color is known at compile time.
+  constexpr inline Bitboard safe_squares(Color color, Castle castle) {
     using namespace squares::bitboards;
-    using namespace colors;
-    static auto safe_squares = [](){
-      array2d<Bitboard, colors::cardinality, castles::cardinality> result;
-      result[white][kingside]  = e1 | f1 | g1;
-      result[white][queenside] = e1 | d1 | c1;
-      result[black][kingside]  = e8 | f8 | g8;
-      result[black][queenside] = e8 | d8 | c8;
-      return result;
-    }();
-    return safe_squares[color][castle];
+    return color == colors::white
+      ? (castle == kingside ? e1 | f1 | g1 : e1 | d1 | c1)
+      : (castle == kingside ? e8 | f8 | g8 : e8 | d8 | c8);
   }
 
-  inline const Bitboard& free_squares(Color color, Castle castle) {
+  constexpr inline Bitboard free_squares(Color color, Castle castle) {
     using namespace squares::bitboards;
-    using namespace colors;
-    static auto free_squares = [](){
-      array2d<Bitboard, colors::cardinality, castles::cardinality> result;
-      result[white][kingside]  = f1 | g1;
-      result[white][queenside] = d1 | c1 | b1;
-      result[black][kingside]  = f8 | g8;
-      result[black][queenside] = d8 | c8 | b8;
-      return result;
-    }();
-    return free_squares[color][castle];
+    return color == colors::white
+      ? (castle == kingside ? f1 | g1 : d1 | c1 | b1)
+      : (castle == kingside ? f8 | g8 : d8 | c8 | b8);
   }
 
-  inline squares::Index king_source(Color color, Castle castle) {
-    using namespace squares;
-    using namespace colors;
-    static auto king_sources = [](){
-      array2d<squares::Index, colors::cardinality, castles::cardinality> result;
-      result[white][kingside]  = e1;
-      result[white][queenside] = e1;
-      result[black][kingside]  = e8;
-      result[black][queenside] = e8;
-      return result;
-    }();
-    return king_sources[color][castle];
+  constexpr inline squares::Index king_source(Color color, Castle castle) {
+    return color == colors::white ? squares::e1 : squares::e8;
   }
 
-  inline squares::Index king_target(Color color, Castle castle) {
+  constexpr inline squares::Index king_target(Color color, Castle castle) {
     using namespace squares;
-    using namespace colors;
-    static auto king_targets = [](){
-      array2d<squares::Index, colors::cardinality, castles::cardinality> result;
-      result[white][kingside]  = g1;
-      result[white][queenside] = c1;
-      result[black][kingside]  = g8;
-      result[black][queenside] = c8;
-      return result;
-    }();
-    return king_targets[color][castle];
+    return color == colors::white
+      ? (castle == kingside ? g1 : c1)
+      : (castle == kingside ? g8 : c8);
   }
 
   inline Color color(squares::Index king_source) {
@@ -146,19 +117,10 @@ namespace castles {
     }
   }
 
-  inline char symbol(Color color, Castle castle) {
-    using namespace squares;
-    using namespace colors;
-    static auto symbols = []() {
-      array2d<char, colors::cardinality, castles::cardinality> result;
-      result[white][kingside]  = 'K';
-      result[white][queenside] = 'Q';
-      result[black][kingside]  = 'k';
-      result[black][queenside] = 'q';
-      return result;
-    }();
-    return symbols[color][castle];
+  constexpr inline char symbol(Color color, Castle castle) {
+    return "KQkq"[color * cardinality + castle];
   }
+
 }
 
 typedef castles::Castle Castle;
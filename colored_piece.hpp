@@ -13,3 +13,20 @@ struct ColoredPiece {
   bool operator==(const ColoredPiece& that) const;
   bool operator!=(const ColoredPiece& that) const;
 };
+
+// one-byte encoding of what occupies a square, as stored in State::mailbox
+namespace mailbox {
+  const uint8_t empty = 0xff;
+
+  inline uint8_t encode(Color color, Piece piece) {
+    return color << 3 | piece;
+  }
+
+  inline Color color(uint8_t code) {
+    return static_cast<Color>(code >> 3);
+  }
+
+  inline Piece piece(uint8_t code) {
+    return static_cast<Piece>(code & 7);
+  }
+}
@@ -2,10 +2,12 @@
 
 #include <string>
 #include <cstddef>
+#include <cstdint>
 
 namespace colors {
 #define COLORS white, black,
-  enum Color { COLORS };
+  // one byte so that State stays compact
+  enum Color : uint8_t { COLORS };
   const Color values[] = { COLORS };
 #undef COLORS
 
@@ -14,7 +16,7 @@ namespace colors {
   std::string name(Color color);
   char symbol(Color color);
 
-  inline Color opposite(Color color) {
+  constexpr Color opposite(Color color) {
     return static_cast<Color>(1 - color);
   }
 }
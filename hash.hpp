@@ -1,8 +1,7 @@
 #pragma once
 
 #include <cstdint>
-
-#include <boost/random.hpp>
+#include <cstring>
 
 #include "util.hpp"
 #include "colors.hpp"
@@ -14,13 +13,11 @@
 typedef uint64_t Hash;
 
 namespace hashes {
-  // all members should be considered const -- cannot make them const because
-  // of serialization.
   struct Hashes {
     Hash black_to_move;
-    array3d<Hash, squares::cardinality, colors::cardinality, pieces::cardinality> colored_piece_at_square;
-    array2d<Hash, colors::cardinality, castles::cardinality> can_castle;
-    std::array<Hash, files::cardinality> en_passant;
+    Hash colored_piece_at_square[squares::cardinality][colors::cardinality][pieces::cardinality];
+    Hash can_castle[colors::cardinality][castles::cardinality];
+    Hash en_passant[files::cardinality];
 
     template<class Archive>
     inline void serialize(Archive& a, const unsigned int version) {
@@ -29,58 +26,55 @@ namespace hashes {
       a & can_castle;
       a & en_passant;
     }
+ 
+    inline bool operator==(Hashes const& that) const {
+      return std::memcmp(this, &that, sizeof(Hashes)) == 0;
+    }
   };
 
-  inline Hash generate_random_feature() {
-    static boost::random::mt19937 base_generator;
-    static boost::random::uniform_int_distribution<Hash> distribution;
-    static boost::variate_generator<boost::mt19937&, boost::random::uniform_int_distribution<Hash>> generator(base_generator, distribution);
-    return generator();
+  // splitmix64, which is simple enough to run at compile time.  see
+  // http://xorshift.di.unimi.it/splitmix64.c
+  constexpr Hash next_feature(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
   }
 
-  inline Hashes& get_hashes() {
-    static Hashes hashes = {
-      generate_random_feature(),
-      []() {
-        array3d<Hash, squares::cardinality, colors::cardinality, pieces::cardinality> x;
-        for (squares::Index s: squares::indices)
-          for (Color c: colors::values)
-            for (Piece p: pieces::values)
-              x[s][c][p] = generate_random_feature();
-        return x;
-      }(),
-      []() {
-        array2d<Hash, colors::cardinality, castles::cardinality> x;
-        for (Color color: colors::values)
-          for (Castle castle: castles::values)
-            x[color][castle] = generate_random_feature();
-        return x;
-      }(),
-      []() {
-        std::array<Hash, files::cardinality> x;
-        for (files::Index file: files::indices)
-          x[file] = generate_random_feature();
-        return x;
-      }(),
-    };
+  constexpr Hashes make_hashes() {
+    Hashes hashes = {};
+    uint64_t state = 0;
+    hashes.black_to_move = next_feature(state);
+    for (size_t s = 0; s < squares::cardinality; s++)
+      for (size_t c = 0; c < colors::cardinality; c++)
+        for (size_t p = 0; p < pieces::cardinality; p++)
+          hashes.colored_piece_at_square[s][c][p] = next_feature(state);
+    for (size_t color = 0; color < colors::cardinality; color++)
+      for (size_t castle = 0; castle < castles::cardinality; castle++)
+        hashes.can_castle[color][castle] = next_feature(state);
+    for (size_t file = 0; file < files::cardinality; file++)
+      hashes.en_passant[file] = next_feature(state);
     return hashes;
   }
 
-  inline Hash black_to_move() {
-    return get_hashes().black_to_move;
+  // generated at compile time into read-only data
+  constexpr Hashes _hashes = make_hashes();
+
+  constexpr inline Hash black_to_move() {
+    return _hashes.black_to_move;
   }
   
-  inline Hash colored_piece_at_square(const Color color, Piece piece, squares::Index square) {
-    return get_hashes().colored_piece_at_square[square][color][piece];
+  constexpr inline Hash colored_piece_at_square(const Color color, Piece piece, squares::Index square) {
+    return _hashes.colored_piece_at_square[square][color][piece];
   }
   
-  inline Hash can_castle(Color color, Castle castle) {
-    return get_hashes().can_castle[color][castle];
+  constexpr inline Hash can_castle(Color color, Castle castle) {
+    return _hashes.can_castle[color][castle];
   }
   
   inline Hash en_passant(Bitboard en_passant_square) {
     files::Index file = files::by_square(squares::index(en_passant_square));
-    return get_hashes().en_passant[file];
+    return _hashes.en_passant[file];
   }
   
   inline void toggle(Hash& hash, Color color, Piece piece, squares::Index square) {
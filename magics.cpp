@@ -0,0 +1,109 @@
+#include "magics.hpp"
+#include "targets.hpp"
+
+using namespace magics;
+
+std::array<Magic, squares::cardinality> magics::bishop_magics;
+std::array<Magic, squares::cardinality> magics::rook_magics;
+
+namespace {
+  // found by trial and error with sparse random candidates; unused by the
+  // PEXT backend.
+  const std::array<Bitboard, squares::cardinality> bishop_magic_numbers = {
+    0x04c4380860440140, 0x002002020a0c2000, 0x8021021400402002, 0x8004242280404200,
+    0x0804030800108200, 0x2001040240080080, 0x0001040104400808, 0x0084808800900444,
+    0x1200100411980200, 0x0000b01080908480, 0x0005088081020090, 0x1091041c21828802,
+    0x0004020210240020, 0x3081011002101580, 0x1500408824100408, 0x2420020100880540,
+    0x0860904002840122, 0x8022003110021082, 0x2042001004001820, 0x4a0800a402102440,
+    0x0884000a00940008, 0x0912006022100200, 0x0411044200822000, 0x0002012101092100,
+    0x00a0840808080800, 0x0204022004080801, 0x1118020001020200, 0x0022008028008002,
+    0x2001001021004000, 0x4000820181004216, 0x00209122008c1000, 0x00c04206a0808400,
+    0x0a01082000082001, 0x0449043088421004, 0x2000180600240c00, 0x000b200800030811,
+    0x80840040101c0100, 0x8012080600204040, 0x0808880040010100, 0x0018309282010040,
+    0x0428040484066080, 0x6202085404500200, 0x2400824240420800, 0x820400d148003400,
+    0x4240200410404c00, 0x081116180a010040, 0x0c60084604a00040, 0x028102020a000049,
+    0x400480842021c040, 0x0002020124421984, 0x4100410088041048, 0x0040800084040400,
+    0x8200011002020416, 0x05480810010a0a11, 0x0010101148428000, 0xa002840802004040,
+    0x0002020622020210, 0x0000228048280401, 0x0102500044041122, 0x4421100400420880,
+    0x2803001c04104414, 0x0002453012108104, 0x0210c00508120441, 0x3040010400820040
+  };
+
+  const std::array<Bitboard, squares::cardinality> rook_magic_numbers = {
+    0x8080102040008000, 0x5440041000200048, 0x008020008010000a, 0x0200084200100420,
+    0x0200081020040200, 0x0600019002002824, 0x040050811008020c, 0x0100004881000126,
+    0x0005800440008020, 0x2882002042090880, 0x0002802000801004, 0x0240808010000800,
+    0x4480800800040082, 0x0408808004000200, 0x00ba0004a8020001, 0x1106000042040091,
+    0x0020208010400080, 0x0022060045028020, 0x0020008020100080, 0x0202020008102041,
+    0x0c50808008000400, 0x0068808002000400, 0x00510400c8100201, 0x400006000100a444,
+    0x483424818008400a, 0x8840008080200040, 0x0800100080802000, 0x0440100080800800,
+    0x4000080080040080, 0x9124040080020080, 0x0089000300040e00, 0x080001020020488c,
+    0x9040002040800080, 0x80d0002001400242, 0x0000401901002002, 0x0030220901001000,
+    0x0080580005003100, 0x0022006c0a001008, 0x0802301144001248, 0x0020010042000084,
+    0x4ac0400084228004, 0x0010004020004000, 0x3110004020010100, 0x0598100009050020,
+    0x4200080011010004, 0x0818020004008080, 0x02a0708102040008, 0x5201010080420004,
+    0x100b124063800100, 0x7808200240048980, 0x8800200010008080, 0x1099201001000900,
+    0x0100050010080100, 0x0400800200040080, 0x2040280190020400, 0x00100c0100608200,
+    0x0000201241088202, 0x1040002042801b01, 0x0124090010200041, 0x0831002004081001,
+    0x2003000800021005, 0x80010002040008c1, 0x0208008122081004, 0x4000008844002102
+  };
+
+  // the number of entries for each square is 2^(number of bits in its mask)
+  std::array<Bitboard, 0x1480>  bishop_table;
+  std::array<Bitboard, 0x19000> rook_table;
+
+  const Bitboard edges = files::bitboards::a | files::bitboards::h | ranks::bitboards::_1 | ranks::bitboards::_8;
+
+  Bitboard bishop_mask(squares::Index source) {
+    return (diagonals::bitboards::by_square(source) | giadonals::bitboards::by_square(source))
+      & ~squares::bitboard(source) & ~edges;
+  }
+
+  Bitboard rook_mask(squares::Index source) {
+    using namespace files::bitboards;
+    using namespace ranks::bitboards;
+    return ((files::bitboards::by_square(source) & ~(_1 | _8)) |
+            (ranks::bitboards::by_square(source) & ~(a | h)))
+      & ~squares::bitboard(source);
+  }
+
+  template <typename T, typename M, typename A>
+  void initialize(std::array<Magic, squares::cardinality>& magics, T& table,
+                  std::array<Bitboard, squares::cardinality> const& magic_numbers,
+                  M mask_fn, A attacks_fn) {
+    size_t offset = 0;
+    for (squares::Index source: squares::indices) {
+      Magic& magic = magics[source];
+      magic.mask = mask_fn(source);
+      magic.magic = magic_numbers[source];
+      magic.shift = 64 - bitboard::cardinality(magic.mask);
+      magic.attacks = &table[offset];
+
+      // enumerate all subsets of the mask (carry-rippler)
+      Bitboard blockers = 0;
+      do {
+        magic.attacks[magic.index(blockers)] = attacks_fn(source, blockers);
+        blockers = (blockers - magic.mask) & magic.mask;
+      } while (blockers);
+
+      offset += size_t(1) << bitboard::cardinality(magic.mask);
+    }
+    assert(offset == table.size());
+  }
+
+  struct Initializer {
+    Initializer() {
+      initialize(bishop_magics, bishop_table, bishop_magic_numbers, bishop_mask, targets::hyperbola_bishop_attacks);
+      initialize(rook_magics,   rook_table,   rook_magic_numbers,   rook_mask,   targets::hyperbola_rook_attacks);
+    }
+  } initializer;
+}
+
+std::string magics::backend() {
+#if defined(MC_HYPERBOLA_ATTACKS)
+  return "hyperbola quintessence";
+#elif defined(MC_PEXT_ATTACKS)
+  return "pext";
+#else
+  return "magic";
+#endif
+}
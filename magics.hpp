@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <string>
+
+#include "bitboard.hpp"
+#include "partitions.hpp"
+
+// backend for sliding piece attacks.  by default this is PEXT if the compiler
+// targets BMI2 (e.g. -mbmi2 or -march=native on Haswell or later) and fancy
+// magics otherwise.  define one of these to override:
+//   MC_PEXT_ATTACKS       index the tables with BMI2 PEXT
+//   MC_MAGIC_ATTACKS      index the tables with magic multiplication
+//   MC_HYPERBOLA_ATTACKS  don't use the tables; compute rays on the fly
+#if !defined(MC_PEXT_ATTACKS) && !defined(MC_MAGIC_ATTACKS) && !defined(MC_HYPERBOLA_ATTACKS)
+#  ifdef __BMI2__
+#    define MC_PEXT_ATTACKS
+#  else
+#    define MC_MAGIC_ATTACKS
+#  endif
+#endif
+
+#ifdef MC_PEXT_ATTACKS
+#  ifndef __BMI2__
+#    error "MC_PEXT_ATTACKS requires a BMI2 target (-mbmi2)"
+#  endif
+#  include <immintrin.h>
+#endif
+
+// after https://chessprogramming.wikispaces.com/Magic+Bitboards
+// the attack set of a slider on a given square depends only on the occupancy
+// of the squares in its mask (its rays, excluding the board edges).  those
+// bits are compressed into a dense index into a table of precomputed attack
+// sets.  the tables are filled when the program starts.
+namespace magics {
+  struct Magic {
+    Bitboard mask;
+    Bitboard magic;
+    unsigned shift;
+    Bitboard* attacks;
+
+    inline size_t index(Bitboard occupancy) const {
+#ifdef MC_PEXT_ATTACKS
+      return _pext_u64(occupancy, mask);
+#else
+      return ((occupancy & mask) * magic) >> shift;
+#endif
+    }
+
+    inline Bitboard lookup(Bitboard occupancy) const {
+      return attacks[index(occupancy)];
+    }
+  };
+
+  extern std::array<Magic, squares::cardinality> bishop_magics;
+  extern std::array<Magic, squares::cardinality> rook_magics;
+
+  inline Bitboard bishop_attacks(squares::Index source, Bitboard occupancy) {
+    return bishop_magics[source].lookup(occupancy);
+  }
+
+  inline Bitboard rook_attacks(squares::Index source, Bitboard occupancy) {
+    return rook_magics[source].lookup(occupancy);
+  }
+
+  // name of the compiled-in backend, for benchmark output
+  std::string backend();
+}
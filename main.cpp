@@ -45,6 +45,24 @@ public:
   }
 };
 
+// the most memory the node table may be given
+const size_t max_megabytes = 1 << 20;
+
+// a whole number from 1 to max, or none if the argument is anything else
+boost::optional<size_t> parse_count(std::string const& argument, size_t max) {
+  try {
+    size_t length;
+    // NOTE: negative numbers are negated modulo ULONG_MAX + 1, and so exceed
+    // any sensible max
+    unsigned long count = std::stoul(argument, &length);
+    if (length == argument.size() && count > 0 && count <= max)
+      return size_t(count);
+  } catch (std::logic_error& e) {
+    // std::invalid_argument or std::out_of_range
+  }
+  return boost::none;
+}
+
 const std::vector<std::string> features = {
   "done=0",
   "ping=1",
@@ -66,7 +84,9 @@ const std::vector<std::string> features = {
   "pause=1",
   "nps=0",
   "debug=1",
-  "memory=0",
+  "memory=1",
+  // the name UCI engines use, for interfaces that translate
+  str(fmt("option=\"Hash -spin %1% 1 %2%\"") % mcts::NodeTable::default_megabytes % max_megabytes),
   "smp=0",
   "done=1",
 };
@@ -83,11 +103,48 @@ int main(int argc, char* argv[]) {
   
   // if present, this is the path to a file where the agent is to be serialized.
   boost::optional<std::string> path_to_storage;
-  if (argc > 0)
-    path_to_storage = std::string(argv[1]);
+  // size of the node table
+  size_t megabytes = mcts::NodeTable::default_megabytes;
+  bool root_parallel = false;
+  // playouts per new leaf; all but one run on worker threads
+  unsigned leaf_playouts = 1;
+
+  auto usage = [&]() {
+    std::cerr << "usage: main [--hash <MB>] [--root-parallel] [--leaf-playouts <N>] [<path to storage>]" << std::endl;
+    return 2;
+  };
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--hash" && i + 1 < argc) {
+      boost::optional<size_t> value = parse_count(argv[++i], max_megabytes);
+      if (!value)
+        return usage();
+      megabytes = *value;
+    } else if (arg == "--root-parallel") {
+      root_parallel = true;
+    } else if (arg == "--leaf-playouts" && i + 1 < argc) {
+      // each playout beyond the first gets a worker thread
+      boost::optional<size_t> value = parse_count(argv[++i], 4 * std::max(1u, boost::thread::hardware_concurrency()));
+      if (!value)
+        return usage();
+      leaf_playouts = *value;
+    } else if (!path_to_storage) {
+      path_to_storage = arg;
+    } else {
+      return usage();
+    }
+  }
 
   Game game;
-  MCTSAgent agent(2);
+  MCTSAgent agent(2, megabytes);
+  if (root_parallel)
+    agent.set_parallelism(MCTSAgent::root_parallel);
+  if (leaf_playouts > 1)
+    agent.set_leaf_parallelism(leaf_playouts, leaf_playouts - 1);
+  // what is stored should cover the whole game
+  if (path_to_storage)
+    agent.set_garbage_collection(false);
   if (path_to_storage && file_readable(*path_to_storage))
     agent.load_yourself(*path_to_storage);
 
@@ -128,6 +185,15 @@ int main(int argc, char* argv[]) {
       report_error("protocol assumption violated", message);
   };
 
+  // a memory size as given to "memory" or "option Hash", or none if it is
+  // malformed
+  auto parse_megabytes = [&](std::string const& argument) {
+    boost::optional<size_t> megabytes = parse_count(argument, max_megabytes);
+    if (!megabytes)
+      report_error("invalid memory size", argument);
+    return megabytes;
+  };
+
   typedef std::vector<std::string> ARGV;
 
   std::function<void(std::vector<std::string>)> do_nothing = [&](ARGV argv){};
@@ -251,11 +317,31 @@ int main(int argc, char* argv[]) {
     {"resume", [&](ARGV argv) {
         agent.resume();
       }},
-    // this could prove to be useful
-    {"memory", unsupported},
+    {"memory", [&](ARGV argv) {
+        if (argv.size() < 2) {
+          report_error("missing argument", argv[0]);
+          return;
+        }
+        if (boost::optional<size_t> megabytes = parse_megabytes(argv[1]))
+          agent.set_memory(*megabytes);
+      }},
     {"cores", unsupported},
     {"egtpath", do_nothing},
-    {"option", do_nothing},
+    {"option", [&](ARGV argv) {
+        // option NAME=VALUE
+        if (argv.size() < 2) {
+          report_error("missing argument", argv[0]);
+          return;
+        }
+        std::vector<std::string> assignment;
+        boost::algorithm::split(assignment, argv[1], boost::algorithm::is_any_of("="));
+        if (assignment.size() == 2 && assignment[0] == "Hash") {
+          if (boost::optional<size_t> megabytes = parse_megabytes(assignment[1]))
+            agent.set_memory(*megabytes);
+        } else {
+          report_error("unsupported option", argv[1]);
+        }
+      }},
   };
 
   auto handle_decision = [&](){
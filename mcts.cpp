@@ -1,65 +1,400 @@
 #include "mcts.hpp"
 #include "notation.hpp"
+#include "playout_pool.hpp"
 
 #include <stack>
+#include <limits>
+#include <tuple>
+#include <algorithm>
+#include <bitset>
 
 #include <boost/range/algorithm/random_shuffle.hpp>
 
 using namespace mcts;
 
-void Node::initialize(State const& state) {
-  hash = NodeTable::key(state.hash);
+// NOTE: a sampler that still holds a pointer to the node's previous occupant
+// may yet update it; such updates are rare and only add noise.
+void Node::initialize(Hash hash) {
+  m_statistics = pack_statistics(0, draw_value);
+  m_derivative = 0;
+  m_variance = 0;
+  set_edges(0);
+  this->hash = hash;
 }
 
 void Node::update(double result) {
-  m_sample_size++;
-  double mean0 = m_mean;
-  double delta = result - mean0;
-  m_mean += delta/m_sample_size;
-  m_derivative = 0.9*m_derivative + 0.1*(m_mean - mean0);
+  uint64_t statistics0 = m_statistics.load(std::memory_order_relaxed), statistics;
+  uint32_t sample_size;
+  double mean0, mean;
+  do {
+    sample_size = unpack_sample_size(statistics0);
+    // saturate rather than wrap; the mean moves too little to matter by then
+    if (sample_size < std::numeric_limits<uint32_t>::max())
+      sample_size++;
+    mean0 = unpack_mean(statistics0);
+    mean = mean0 + (result - mean0)/sample_size;
+    statistics = pack_statistics(sample_size, mean);
+  } while (!m_statistics.compare_exchange_weak(statistics0, statistics, std::memory_order_relaxed));
+
+  float derivative0 = m_derivative.load(std::memory_order_relaxed);
+  while (!m_derivative.compare_exchange_weak(derivative0, 0.9*derivative0 + 0.1*(mean - mean0),
+                                             std::memory_order_relaxed));
+
+  // Welford's method, with the means from the update above
+  uint32_t variance0 = m_variance.load(std::memory_order_relaxed);
+  while (!m_variance.compare_exchange_weak(variance0, pack_variance(unpack_variance(variance0) + ((result - mean0)*(result - mean) - unpack_variance(variance0))/sample_size),
+                                           std::memory_order_relaxed));
 }
 
-void Node::adjoin_parent(Node* parent) {
-  std::lock_guard<std::mutex> lock(parents_mutex);
-  parents.insert(parent->hash);
+void Node::set_mean(double mean) {
+  uint64_t statistics0 = m_statistics.load(std::memory_order_relaxed), statistics;
+  do {
+    statistics = pack_statistics(unpack_sample_size(statistics0), mean);
+  } while (!m_statistics.compare_exchange_weak(statistics0, statistics, std::memory_order_relaxed));
 }
 
-std::string Node::format_statistics() {
-  return str(boost::format("%1% %2% (d %3%) %4% (%5% parents)")
-             % sample_size()
-             % mean()
-             % derivative()
-             % selection_criterion()
-             % parents.size());
-}
-
-Node* NodeTable::get(Hash hash) {
-  size_t key = NodeTable::key(hash);
-  Node* node = &nodes.at(key);
-  if (node->hash != key)
-    return nullptr;
+const size_t NodeTable::default_megabytes;
+
+Node* NodeTable::probe(Hash hash) {
+  size_t index = bucket_key(hash);
+  Bucket& bucket = buckets[index];
+  for (size_t way = 0; way < WAYS; way++) {
+    if (bucket.tags[way].load(std::memory_order_acquire) != tag(hash))
+      continue;
+    Node* node = &nodes[index * WAYS + way];
+    if (node->hash != hash || bucket.generations[way].load(std::memory_order_relaxed) == 0)
+      continue;
+    if (bucket.generations[way].load(std::memory_order_relaxed) != generation)
+      bucket.generations[way].store(generation, std::memory_order_relaxed);
+    return node;
+  }
+  return nullptr;
+}
+
+Node* NodeTable::store(Hash hash) {
+  size_t index = bucket_key(hash);
+  Bucket& bucket = buckets[index];
+  while (bucket.lock.test_and_set(std::memory_order_acquire));
+
+  // another thread may have stored it in the meantime
+  Node* node = probe(hash);
+  if (!node) {
+    size_t victim = 0;
+    std::tuple<bool, bool, double> victim_value;
+    for (size_t way = 0; way < WAYS; way++) {
+      if (bucket.generations[way].load(std::memory_order_relaxed) == 0) {
+        victim = way;
+        break;
+      }
+      Node const& candidate = nodes[index * WAYS + way];
+      auto value = std::make_tuple(candidate.pending() > 0,
+                                   bucket.generations[way].load(std::memory_order_relaxed) == generation,
+                                   candidate.sample_size());
+      if (way == 0 || value < victim_value) {
+        victim = way;
+        victim_value = value;
+      }
+    }
+
+    // unpublish the entry while the node is reinitialized
+    bucket.tags[victim].store(0, std::memory_order_relaxed);
+    bucket.generations[victim].store(0, std::memory_order_relaxed);
+    node = &nodes[index * WAYS + victim];
+    node->initialize(hash);
+    parent_lists[index * WAYS + victim].store(0, std::memory_order_relaxed);
+    bucket.generations[victim].store(generation, std::memory_order_relaxed);
+    bucket.tags[victim].store(tag(hash), std::memory_order_release);
+    m_expansions++;
+  }
+
+  bucket.lock.clear(std::memory_order_release);
   return node;
 }
 
 Node* NodeTable::get_or_create(State const& state) {
-  size_t key = NodeTable::key(state);
-  Node* node = &nodes.at(key);
-  if (node->hash != key)
-    node->initialize(state);
-  return node;
+  Node* node = probe(state.hash);
+  return node ? node : store(state.hash);
+}
+
+void NodeTable::age() {
+  generation = generation == std::numeric_limits<Generation>::max() ? 1 : generation + 1;
+}
+
+// half of the memory goes to the nodes, a quarter each to their parent links
+// and edges (with the edges' AMAF statistics).
+void NodeTable::allocate(size_t megabytes) {
+  size_t bytes = megabytes << 20;
+  size_t bucket_size = sizeof(Bucket) + WAYS * (sizeof(Node) + sizeof(std::atomic<uint32_t>));
+  size_t bucket_count = 1;
+  while (2 * bucket_count * bucket_size <= bytes / 2)
+    bucket_count *= 2;
+  // release the old table first so that both needn't fit at once
+  decltype(buckets)().swap(buckets);
+  std::vector<Node>().swap(nodes);
+  std::vector<std::atomic<uint32_t> >().swap(parent_lists);
+  buckets = decltype(buckets)(bucket_count);
+  nodes = std::vector<Node>(bucket_count * WAYS);
+  parent_lists = std::vector<std::atomic<uint32_t> >(bucket_count * WAYS);
+  bucket_mask = bucket_count - 1;
+  parent_links.resize(bytes / 4 / sizeof(ParentLink));
+  size_t edge_count = bytes / 4 / (sizeof(Edge) + sizeof(std::atomic<uint64_t>));
+  edges_arena.resize(edge_count);
+  std::vector<std::atomic<uint64_t> >().swap(amaf_statistics);
+  amaf_statistics = std::vector<std::atomic<uint64_t> >(edges_arena.capacity());
+}
+
+// the nodes in use are taken out and stored anew, as load does, so that the
+// old and the new table needn't fit at once.  they are stored fewest samples
+// first, so that if the new table is smaller, those are the ones evicted.
+// edges and AMAF statistics are dropped; nodes are expanded again when next
+// selected.
+void NodeTable::resize(size_t megabytes) {
+  struct Survivor {
+    Node node;
+    // its parents in the parents vector below
+    size_t first_parent, last_parent;
+  };
+  std::vector<Survivor> survivors;
+  std::vector<Hash> parents;
+  for (size_t key = 0; key < buckets.size(); key++) {
+    for (size_t way = 0; way < WAYS; way++) {
+      if (buckets[key].generations[way] == 0)
+        continue;
+      Node const* node = &nodes[key * WAYS + way];
+      size_t first_parent = parents.size();
+      do_parents(node, [&](Hash parent) {
+          parents.push_back(parent);
+        });
+      survivors.push_back(Survivor{*node, first_parent, parents.size()});
+    }
+  }
+  std::sort(survivors.begin(), survivors.end(), [](Survivor const& a, Survivor const& b) {
+      return a.node.sample_size() < b.node.sample_size();
+    });
+
+  allocate(megabytes);
+  for (Survivor const& survivor: survivors) {
+    Node* stored = store(survivor.node.hash);
+    *stored = survivor.node;
+    for (size_t i = survivor.first_parent; i < survivor.last_parent; i++)
+      adjoin_parent(stored, parents[i]);
+  }
+}
+
+void NodeTable::clear() {
+  for (Bucket& bucket: buckets) {
+    for (size_t way = 0; way < WAYS; way++) {
+      bucket.tags[way] = 0;
+      bucket.generations[way] = 0;
+    }
+  }
+  for (Node& node: nodes)
+    node = Node();
+  for (std::atomic<uint32_t>& list: parent_lists)
+    list = 0;
+  parent_links.clear();
+  edges_arena.clear();
+}
+
+// mark: a depth-first search from the root over edges, and over the legal
+// moves of sampled nodes that haven't been expanded.  only nodes that have
+// been sampled can have successors in the table, so the others are marked
+// without making their moves.
+// sweep: unmarked entries are emptied.
+// compact: live edge runs and parent links are slid to the front of their
+// arenas in index order, so that the space of dead ones is reclaimed.
+size_t NodeTable::collect(State const& root) {
+  std::vector<bool> live(nodes.size(), false);
+  // the slots of the live nodes, so that the passes below needn't scan the
+  // whole table
+  std::vector<uint32_t> kept;
+  std::vector<State> backlog;
+  auto mark = [&](Node* node, State const& state) {
+    if (live[index(node)])
+      return;
+    live[index(node)] = true;
+    kept.push_back(index(node));
+    if (node->sample_size() > 0)
+      backlog.push_back(state);
+  };
+  if (Node* node = probe(root.hash))
+    mark(node, root);
+
+  while (!backlog.empty()) {
+    State state = backlog.back();
+    backlog.pop_back();
+    Node* node = probe(state.hash);
+    if (node->expanded()) {
+      for (Edge const& edge: edges(node)) {
+        Node* child = at(edge.index);
+        if (child->hash != edge.hash && !(child = probe(edge.hash)))
+          continue;
+        if (live[index(child)])
+          continue;
+        State successor(state);
+        successor.make_move(edge.move);
+        mark(child, successor);
+      }
+    } else {
+      node->do_successors(state, [&](State const& successor, Move move) {
+          if (Node* child = probe(successor.hash))
+            mark(child, successor);
+        });
+    }
+  }
+
+  for (size_t key = 0; key < buckets.size(); key++) {
+    for (size_t way = 0; way < WAYS; way++) {
+      size_t slot = key * WAYS + way;
+      if (buckets[key].generations[way] == 0 || live[slot])
+        continue;
+      buckets[key].tags[way] = 0;
+      buckets[key].generations[way] = 0;
+      nodes[slot] = Node();
+      parent_lists[slot] = 0;
+    }
+  }
+
+  // edge runs, by where they start
+  std::vector<std::pair<uint32_t, uint32_t> > runs;
+  for (uint32_t slot: kept)
+    if (nodes[slot].expanded())
+      runs.emplace_back(nodes[slot].edges(), slot);
+  std::sort(runs.begin(), runs.end());
+  uint32_t edges_size = 1;
+  for (auto const& run: runs) {
+    // the header's index is the number of edges that follow it
+    uint32_t length = edges_arena[run.first].index + 1;
+    if (run.first != edges_size) {
+      std::copy(&edges_arena[run.first], &edges_arena[run.first] + length, &edges_arena[edges_size]);
+      for (uint32_t i = 0; i < length; i++)
+        amaf_statistics[edges_size + i].store(amaf_statistics[run.first + i].load());
+      nodes[run.second].set_edges(edges_size);
+    }
+    edges_size += length;
+  }
+  edges_arena.truncate(edges_size);
+
+  // drop links to dead parents, relinking each list past them, and note the
+  // links that remain
+  std::vector<uint32_t> links;
+  for (uint32_t slot: kept) {
+    uint32_t* previous = nullptr;
+    uint32_t link = parent_lists[slot];
+    parent_lists[slot] = 0;
+    for (; link != 0; link = parent_links[link].next) {
+      Node* parent = probe(parent_links[link].parent);
+      if (!parent)
+        continue;
+      if (previous)
+        *previous = link;
+      else
+        parent_lists[slot] = link;
+      previous = &parent_links[link].next;
+      links.push_back(link);
+    }
+    if (previous)
+      *previous = 0;
+  }
+  // a link's new index is one more than its rank among the remaining ones
+  std::sort(links.begin(), links.end());
+  auto relocated = [&](uint32_t link) -> uint32_t {
+    return link == 0 ? 0 : std::lower_bound(links.begin(), links.end(), link) - links.begin() + 1;
+  };
+  for (uint32_t slot: kept)
+    parent_lists[slot] = relocated(parent_lists[slot]);
+  for (size_t i = 0; i < links.size(); i++) {
+    ParentLink link = parent_links[links[i]];
+    link.next = relocated(link.next);
+    parent_links[i + 1] = link;
+  }
+  parent_links.truncate(links.size() + 1);
+
+  return kept.size();
+}
+
+void NodeTable::adjoin_parent(Node const* node, Hash parent) {
+  std::atomic<uint32_t>& list = parent_lists[index(node)];
+  uint32_t first = list.load(std::memory_order_acquire);
+  // links are only ever prepended, so whatever follows first has been seen
+  uint32_t seen = 0;
+  uint32_t link = 0;
+  do {
+    for (uint32_t curr = first; curr != seen; curr = parent_links[curr].next)
+      if (parent_links[curr].parent == parent)
+        return;
+    seen = first;
+    if (link == 0 && (link = parent_links.allocate()) == 0)
+      return;
+    parent_links[link].parent = parent;
+    parent_links[link].next = first;
+  } while (!list.compare_exchange_weak(first, link, std::memory_order_release, std::memory_order_acquire));
+}
+
+size_t NodeTable::count_parents(Node const* node) const {
+  size_t count = 0;
+  do_parents(node, [&](Hash parent) {
+      count++;
+    });
+  return count;
+}
+
+bool NodeTable::set_edges(Node* node, std::vector<Edge> const& edges) {
+  uint32_t first = edges_arena.allocate(edges.size() + 1);
+  if (first == 0)
+    return false;
+  edges_arena[first] = Edge{0, uint32_t(edges.size()), 0, Move()};
+  std::copy(edges.begin(), edges.end(), &edges_arena[first + 1]);
+  // the arena may have been cleared since these were last used
+  for (uint32_t i = first + 1; i <= first + edges.size(); i++)
+    amaf_statistics[i].store(0, std::memory_order_relaxed);
+  node->set_edges(first);
+  return true;
 }
 
 void Graph::sample(State state, boost::mt19937& generator) {
+  switch (selection_mode) {
+  case selection_derivative: sample(state, generator, derivative_policy); break;
+  case selection_uct:        sample(state, generator, uct_policy);        break;
+  case selection_ucb1_tuned: sample(state, generator, ucb1_tuned_policy); break;
+  case selection_puct:       sample(state, generator, puct_policy);       break;
+  }
+}
+
+template <typename Policy>
+void Graph::sample(State state, boost::mt19937& generator, Policy const& policy) {
   Node* node = nodes.get_or_create(state);
   sorted_vector<Hash> path;
+  // the nodes selected through, in order; each carries a pending sample
+  // until backprop
+  std::vector<Node*> trajectory;
+  // the moves made, starting from the root; only kept for RAVE
+  std::vector<Move> moves;
 
   double result;
 
-  // selection
+  // selection, until a node is reached that has never been sampled.  that
+  // node is all the tree grows by; the rest of the game is played out without
+  // storing anything.
   while (true) {
     path.insert(node->hash);
+    node->add_virtual_loss();
+    trajectory.push_back(node);
+
+    if (node->sample_size() == 0) {
+      // only the moves of this first playout count for RAVE
+      result = rollout(state, generator, rave.enabled ? &moves : nullptr);
+      if (leaf_playouts > 1) {
+        PlayoutPool::Playout playout = [this, &state](boost::mt19937& generator) {
+          return rollout(state, generator);
+        };
+        result = (result + playout_pool->total(leaf_playouts - 1, playout, generator)) / leaf_playouts;
+      }
+      break;
+    }
 
-    Node* child = select_child(node, state, generator);
+    Move move;
+    Node* child = select_child(node, state, move, generator, policy);
 
     if (!child) {
       // no legal successors; game over
@@ -72,6 +407,9 @@ void Graph::sample(State state, boost::mt19937& generator) {
       break;
     }
 
+    if (rave.enabled)
+      moves.push_back(move);
+
     if (state.drawn_by_50() || path.contains(child->hash)) {
       // draw per 50-move rule or by choosing repetition
       result = draw_value;
@@ -81,98 +419,335 @@ void Graph::sample(State state, boost::mt19937& generator) {
     node = child;
   }
 
-  backprop(node, result);
+  if (rave.enabled)
+    backprop_amaf(trajectory, moves, result);
+  backprop(trajectory, result);
 }
 
-// returns nullptr if no legal successor states
-// NOTE: state will be modified to be the corresponding successor
-Node* Graph::select_child(Node* node, State& state, boost::mt19937& generator) {
-  if (node->sample_size() < 30) {
-    // don't waste time with unreliable statistics
+Graph::Graph(size_t megabytes)
+  : nodes(megabytes),
+    m_updates(0),
+    leaf_playouts(1),
+    backprop_mode(backprop_path),
+    selection_mode(selection_derivative)
+{}
+
+Graph::~Graph() {}
+
+void Graph::set_leaf_parallelism(unsigned playouts, unsigned nworkers, boost::mt19937& generator) {
+  set_leaf_parallelism(playouts, playouts > 1 ? std::make_shared<PlayoutPool>(nworkers, generator) : nullptr);
+}
+
+void Graph::set_leaf_parallelism(unsigned playouts, std::shared_ptr<PlayoutPool> pool) {
+  leaf_playouts = pool ? std::max(1u, playouts) : 1;
+  playout_pool = std::move(pool);
+}
+
+// in pawns
+static const double piece_values[pieces::cardinality] = {1, 3, 3, 5, 9, 0};
+
+// the material of the given color less that of the other, in pawns
+static double material_balance(State const& state, Color color) {
+  double balance = 0;
+  for (Piece piece: pieces::values) {
+    balance += piece_values[piece] * (double(bitboard::cardinality(state.board[color][piece]))
+                                      - double(bitboard::cardinality(state.board[colors::opposite(color)][piece])));
+  }
+  return balance;
+}
+
+// plays random legal moves to the end of the game or to the cutoff,
+// appending them to moves if given.  the result is from the perspective of
+// the player to move in the given state.
+double Graph::rollout(State state, boost::mt19937& generator, std::vector<Move>* moves) const {
+  Color us = state.us;
+  for (unsigned ply = 0; !state.drawn_by_50(); ply++) {
+    if (cutoff.enabled) {
+      double balance = material_balance(state, us);
+      if (ply >= cutoff.max_plies || std::abs(balance) >= cutoff.decisive_material)
+        return cutoff.adjudicate(balance);
+    }
     boost::optional<Move> move = moves::make_random_legal_move(state, generator);
-    if (!move)
+    if (moves && move)
+      moves->push_back(*move);
+    if (!move) {
+      boost::optional<Color> winner = state.winner();
+      return !winner
+        ? draw_value
+        : (*winner == us
+           ? win_value
+           : loss_value);
+    }
+  }
+  return draw_value;
+}
+
+// returns nullptr if no legal successor states
+// NOTE: state will be modified to be the corresponding successor, and move
+// set to the move that leads there
+template <typename Policy>
+Node* Graph::select_child(Node* node, State& state, Move& move, boost::mt19937& generator, Policy const& policy) {
+  // don't waste time with unreliable statistics, and make do without them
+  // if there is no room to expand the node
+  if (node->sample_size() < policy.random_below || !(node->expanded() || expand(node, state))) {
+    boost::optional<Move> random_move = moves::make_random_legal_move(state, generator);
+    if (!random_move)
       return nullptr;
+    move = *random_move;
     Node* child = nodes.get_or_create(state);
-    child->adjoin_parent(node);
+    nodes.adjoin_parent(child, node->hash);
     return child;
   } else {
     // use statistics to make selection
-    std::vector<Move> moves;
-    moves::moves(moves, state);
-
-    // find a legal move with maximum selection criterion.
-    boost::optional<Move> best_move;
+    // find an edge with maximum score
+    policies::Parent parent(node->sample_size());
+    Edge const* best_edge = nullptr;
     Node* best_child;
     double best_score;
-    
-    for (Move curr_move: moves) {
-      Undo undo = state.make_move(curr_move);
-      
-      // if legal
-      if (!state.their_king_attacked()) {
-        Node* curr_child = nodes.get_or_create(state);
-        
-        curr_child->adjoin_parent(node);
-        if (curr_child->sample_size() < 10)
-          // select new nodes unconditionally
-          return curr_child;
-        
-        double curr_score = curr_child->selection_criterion(generator);
-        if (!best_move || curr_score > best_score) {
-          best_move  = curr_move;
-          best_child = curr_child;
-          best_score = curr_score;
+
+    EdgeRange edges = nodes.edges(node);
+    if (widening.enabled)
+      edges.count = std::min<size_t>(edges.count, widening.width(node->sample_size()));
+
+    for (Edge const& edge: edges) {
+      Node* child = nodes.at(edge.index);
+      if (child->hash != edge.hash) {
+        // the child has been evicted since expansion, and maybe stored anew
+        child = nodes.probe(edge.hash);
+        if (child)
+          nodes.adjoin_parent(child, node->hash);
+      }
+
+      if (!child || child->effective_sample_size(virtual_loss) < policy.forced_below) {
+        // select new nodes unconditionally
+        move = edge.move;
+        state.make_move(edge.move);
+        if (!child) {
+          child = nodes.get_or_create(state);
+          nodes.adjoin_parent(child, node->hash);
         }
+        return child;
+      }
+
+      Estimate estimate = child->estimate(virtual_loss);
+      if (rave.enabled)
+        rave.blend(estimate, nodes.amaf(edge).load(std::memory_order_relaxed));
+      double score = policy.score(parent, estimate, edge.prior, generator);
+      if (!best_edge || score > best_score) {
+        best_edge  = &edge;
+        best_child = child;
+        best_score = score;
       }
-      
-      state.unmake_move(undo);
     }
 
-    if (!best_move)
+    if (!best_edge)
       return nullptr;
-    state.make_move(*best_move);
+    move = best_edge->move;
+    state.make_move(best_edge->move);
     return best_child;
   }
 }
+
+// a cheap guess at how good a move is before anything is known about it:
+// captures (the more valuable the victim, the better), checks and promotions
+// deserve a look before quiet moves.
+static float prior_weight(State const& state, State const& successor, Move move) {
+  float weight = 1;
+  if (move.is_capture()) {
+    // an en-passant capture's target square is empty
+    boost::optional<ColoredPiece> victim = state.colored_piece_at(move.target());
+    weight += 1 + piece_values[victim ? victim->piece : pieces::pawn];
+  }
+  if (move.promotion() == pieces::queen)
+    weight += 4;
+  if (successor.in_check())
+    weight += 2;
+  return weight;
+}
+
+// link the node to its successors once, so that selection can do without
+// generating and making moves.  the edges are ranked by prior, best first,
+// for progressive widening.  returns false if there is no room.
+bool Graph::expand(Node* node, State const& state) {
+  std::vector<Edge> edges;
+  float total_weight = 0;
+  node->do_successors(state, [&](State const& successor, Move move) {
+      Node* child = nodes.get_or_create(successor);
+      nodes.adjoin_parent(child, node->hash);
+      float weight = prior_weight(state, successor, move);
+      total_weight += weight;
+      edges.push_back(Edge{successor.hash, nodes.index(child), weight, move});
+    });
+  for (Edge& edge: edges)
+    edge.prior /= total_weight;
+  std::stable_sort(edges.begin(), edges.end(), [](Edge const& a, Edge const& b) {
+      return a.prior > b.prior;
+    });
+  return nodes.set_edges(node, edges);
+}
   
-// update the node and all of its ancestors.  the graph is likely to be
-// cyclic due to reversible moves.
+// update the last node of the trajectory and, depending on backprop_mode,
+// either the rest of the trajectory or all of its ancestors.
 // NOTE: initial_result is from the perspective of the player who is to move in
-// the state corresponding to node.  since the stored node values are from the
-// perspective of the player who causes the node to be chosen, we have to invert
-// it once.
-void Graph::backprop(Node* node, double initial_result) {
+// the state corresponding to the last node.  since the stored node values are
+// from the perspective of the player who causes the node to be chosen, we have
+// to invert it once.
+void Graph::backprop(std::vector<Node*> const& trajectory, double initial_result) {
   initial_result = invert_result(initial_result);
+  size_t updates = 0;
 
-  std::unordered_set<Hash> encountered_nodes;
-  auto encountered = [&](Hash hash) {
-    if (encountered_nodes.find(hash) != encountered_nodes.end()) {
-      return true;
-    } else {
-      encountered_nodes.insert(hash);
-      return false;
+  switch (backprop_mode) {
+  case backprop_ancestors: {
+    // the graph is likely to be cyclic due to reversible moves.
+    std::unordered_set<Hash> encountered_nodes;
+    auto encountered = [&](Hash hash) {
+      if (encountered_nodes.find(hash) != encountered_nodes.end()) {
+        return true;
+      } else {
+        encountered_nodes.insert(hash);
+        return false;
+      }
+    };
+
+    std::stack<std::pair<Node*, double> > backlog;
+    backlog.emplace(trajectory.back(), initial_result);
+
+    while (!backlog.empty()) {
+      std::pair<Node*, double> pair = backlog.top();
+      backlog.pop();
+
+      Node* node = pair.first;
+      double result = pair.second;
+      node->update(result);
+      updates++;
+
+      double parent_result = invert_result(result);
+      nodes.do_parents(node, [&](Hash parent) {
+          if (encountered(parent))
+            return;
+          // the parent may have been evicted
+          if (Node* parent_node = nodes.probe(parent))
+            backlog.emplace(parent_node, parent_result);
+        });
     }
+    break;
+  }
+  case backprop_path:
+  case backprop_path_aggregated: {
+    double result = initial_result;
+    for (auto it = trajectory.rbegin(); it != trajectory.rend(); it++) {
+      (*it)->update(result);
+      if (backprop_mode == backprop_path_aggregated)
+        aggregate(*it);
+      result = invert_result(result);
+    }
+    updates += trajectory.size();
+    break;
+  }
+  }
+  m_updates += updates;
+
+  // only now that the real results are in
+  for (Node* node: trajectory)
+    node->remove_virtual_loss();
+}
+
+// credit each edge on the trajectory whose move was played later on in the
+// sample by the player to move there.  moves are told apart by their source
+// and target squares.
+void Graph::backprop_amaf(std::vector<Node*> const& trajectory, std::vector<Move> const& moves, double initial_result) {
+  auto key = [](Move move) {
+    return move.source() * squares::cardinality + move.target();
   };
+  // moves made from the current node on, by ply parity
+  std::bitset<squares::cardinality * squares::cardinality> played[2];
+  size_t ply = moves.size();
+  for (size_t k = trajectory.size(); k-- > 0; ) {
+    while (ply > k) {
+      ply--;
+      played[ply % 2].set(key(moves[ply]));
+    }
+    // from the perspective of the player to move in the node, which is that
+    // of the edges
+    double result = (trajectory.size() - 1 - k) % 2 == 0 ? initial_result : invert_result(initial_result);
+    for (Edge const& edge: nodes.edges(trajectory[k])) {
+      if (!played[k % 2].test(key(edge.move)))
+        continue;
+      std::atomic<uint64_t>& amaf = nodes.amaf(edge);
+      uint64_t statistics0 = amaf.load(std::memory_order_relaxed), statistics;
+      do {
+        uint32_t sample_size = Node::unpack_sample_size(statistics0);
+        if (sample_size < std::numeric_limits<uint32_t>::max())
+          sample_size++;
+        double mean = Node::unpack_mean(statistics0);
+        statistics = Node::pack_statistics(sample_size, mean + (result - mean)/sample_size);
+      } while (!amaf.compare_exchange_weak(statistics0, statistics, std::memory_order_relaxed));
+    }
+  }
+}
 
-  std::stack<std::pair<Node*, double> > backlog;
-  backlog.emplace(node, initial_result);
-  
-  while (!backlog.empty()) {
-    std::pair<Node*, double> pair = backlog.top();
-    backlog.pop();
-    
-    Node* node = pair.first;
-    double result = pair.second;
-    node->update(result);
-
-    double parent_result = invert_result(result);
-    node->do_parents([&](Hash parent) {
-        if (!encountered(parent))
-          backlog.emplace(nodes.get(parent), parent_result);
+// replace the statistics of the nodes within depth moves of the root by
+// those pooled from the same nodes in the given graphs, which may be sampling
+// meanwhile.  this is how root-parallel samplers, each with a graph of its
+// own, are combined into one view.  nodes that the given graphs no longer
+// have samples for (e.g. after evicting them) are reset, so that no stale
+// statistics from earlier merges remain; the search stops where neither
+// side has anything.
+// NOTE: not to be called by two threads at once
+void Graph::merge(std::vector<Graph*> const& graphs, State const& root, unsigned depth) {
+  double sample_size = 0, total = 0;
+  for (Graph* graph: graphs) {
+    if (Node* node = graph->nodes.probe(root.hash)) {
+      uint64_t statistics = node->statistics();
+      sample_size += Node::unpack_sample_size(statistics);
+      total += Node::unpack_sample_size(statistics) * Node::unpack_mean(statistics);
+    }
+  }
+  Node* node;
+  if (sample_size > 0) {
+    node = nodes.get_or_create(root);
+    node->set_statistics(std::min<double>(sample_size, std::numeric_limits<uint32_t>::max()), total / sample_size);
+  } else if ((node = nodes.probe(root.hash)) && node->sample_size() > 0) {
+    node->set_statistics(0, draw_value);
+  } else {
+    return;
+  }
+  if (depth > 0) {
+    node->do_successors(root, [&](State const& successor, Move move) {
+        merge(graphs, successor, depth - 1);
       });
   }
 }
 
+// replace the node's mean by that of its children, so that what is learned
+// about a position through one of its parents reaches the others (as in UCT3).
+// the children's means are from the perspective of the player to move in the
+// node, so the aggregate is inverted.
+void Graph::aggregate(Node* node) {
+  if (!node->expanded())
+    return;
+  double sample_size = 0, total = 0;
+  for (Edge const& edge: nodes.edges(node)) {
+    Node* child = nodes.at(edge.index);
+    if (child->hash != edge.hash && !(child = nodes.probe(edge.hash)))
+      continue;
+    uint64_t statistics = child->statistics();
+    sample_size += Node::unpack_sample_size(statistics);
+    total += Node::unpack_sample_size(statistics) * Node::unpack_mean(statistics);
+  }
+  if (sample_size > 0)
+    node->set_mean(invert_result(total / sample_size));
+}
+
+std::string Graph::format_statistics(Node const* node) {
+  return str(boost::format("%1% %2% (d %3%) %4% (%5% parents)")
+             % node->sample_size()
+             % node->mean()
+             % node->derivative()
+             % node->selection_criterion()
+             % nodes.count_parents(node));
+}
+
 template <typename F>
 boost::optional<Move> Graph::select_successor_by(State state, F f) {
   Node* node = nodes.get_or_create(state);
@@ -191,10 +766,10 @@ boost::optional<Move> Graph::select_successor_by(State state, F f) {
 
 void Graph::print_statistics(std::ostream& os, State state) {
   Node* node = nodes.get_or_create(state);
-  os << node->format_statistics() << std::endl;
+  os << format_statistics(node) << std::endl;
   node->do_successors(state, [&](State const& state, Move last_move) {
       Node* node = nodes.get_or_create(state);
-      os << last_move << " " << node->format_statistics() << std::endl;
+      os << last_move << " " << format_statistics(node) << std::endl;
     });
 }
 
@@ -218,7 +793,7 @@ void Graph::print_principal_variation(std::ostream& os, State state, sorted_vect
   if (child->sample_size() == 0 || path.contains(child->hash))
     return;
   path.insert(child->hash);
-  os << *move << " " << child->format_statistics() << std::endl;
+  os << *move << " " << format_statistics(child) << std::endl;
   print_principal_variation(os, state, path);
 }
 
@@ -231,12 +806,12 @@ void Graph::graphviz(std::ostream& os, Node* node, State state, boost::optional<
      << "[label=\"{"
      << (last_move ? notation::coordinate::format(*last_move) : "-")
      << " | "
-     << node->format_statistics()
+     << format_statistics(node)
      << "}\"];"
      << std::endl;
   node->do_successors(state, [&](State state, Move last_move) {
       // only include existing nodes (to keep the graph small)
-      Node* child = nodes.get(state.hash);
+      Node* child = nodes.probe(state.hash);
       if (!child)
         return;
       graphviz(os, node, state, last_move);
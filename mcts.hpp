@@ -1,7 +1,9 @@
 #pragma once
 
-#include <mutex>
+#include <atomic>
 #include <cmath>
+#include <limits>
+#include <memory>
 
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/noncopyable.hpp>
@@ -9,9 +11,14 @@
 #include <boost/accumulators/statistics.hpp>
 #include <boost/accumulators/statistics/rolling_mean.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/align/aligned_allocator.hpp>
 
 #include "state.hpp"
 #include "sorted_vector.hpp"
+#include "arena.hpp"
+
+class PlayoutPool;
 
 namespace mcts {
   namespace ac = boost::accumulators;
@@ -25,136 +32,611 @@ namespace mcts {
     return 1 - result;
   }
 
+  // steers concurrent samplers apart: while samples are in flight through a
+  // node, it looks worse to other samplers choosing among its siblings.
+  struct VirtualLoss {
+    enum Mode {
+      none,
+      // count each pending sample as `value` lost samples
+      pessimistic,
+      // subtract `value` from the selection criterion per pending sample
+      constant,
+    };
+    Mode mode;
+    double value;
+
+    VirtualLoss(Mode mode = pessimistic, double value = 1)
+      : mode(mode), value(value)
+    {}
+  };
+
+  // an expanded node's link to one of its successors
+  struct Edge {
+    // the child's hash, to tell whether its slot has since been given to
+    // another node
+    Hash hash;
+    // the child's slot in the node table
+    uint32_t index;
+    // probability of the move being chosen before anything is known
+    float prior;
+    Move move;
+  };
+
+  // a node's edges as stored in the node table's edge arena
+  struct EdgeRange {
+    Edge const* first;
+    uint32_t count;
+
+    inline Edge const* begin() const { return first; }
+    inline Edge const* end() const { return first + count; }
+    inline size_t size() const { return count; }
+  };
+
+  // a node's statistics as selection sees them, with the samples in flight
+  // through it counted in as the virtual loss prescribes
+  struct Estimate {
+    double sample_size, mean, variance, derivative;
+  };
+
+  // NOTE: parents and edges are kept by the NodeTable, so that nodes are small
+  // and can be preallocated by the million.
   class Node {
-    size_t m_sample_size;
-    // mean empirical result
-    double m_mean;
-    // estimated derivative of mean with respect to sample size
-    double m_derivative;
+    // sample size in the high half and mean empirical result as a binary
+    // fraction in the low half, so that concurrent updates can be made with a
+    // single compare-and-swap and readers always see a consistent pair.
+    std::atomic<uint64_t> m_statistics;
+    // estimated derivative of mean with respect to sample size.  single
+    // precision keeps the node within 32 bytes without rounding small
+    // derivatives away.
+    std::atomic<float> m_derivative;
+    // number of samples currently selected through this node; not persistent
+    std::atomic<uint16_t> m_pending;
+    // where the node's edges start in the edge arena, or 0 if the node hasn't
+    // been expanded; not persistent
+    std::atomic<uint32_t> m_edges;
+    // variance of the results, as a binary fraction.  results are in [0, 1],
+    // so it is at most 1/4.
+    std::atomic<uint32_t> m_variance;
+
+    static const unsigned MEAN_FRACTION_BITS = 31;
+    static const uint64_t MEAN_MASK = (uint64_t(1) << 32) - 1;
+    static const int VARIANCE_FRACTION_BITS = 34;
+
+    static inline uint32_t pack_variance(double variance) {
+      double scaled = std::round(std::ldexp(variance, VARIANCE_FRACTION_BITS));
+      return std::max(0.0, std::min(double(std::numeric_limits<uint32_t>::max()), scaled));
+    }
+    static inline double unpack_variance(uint32_t variance) {
+      return std::ldexp(double(variance), -VARIANCE_FRACTION_BITS);
+    }
 
   public:
-    sorted_vector<Hash> parents;
-    std::mutex parents_mutex;
+    static inline uint64_t pack_statistics(uint32_t sample_size, double mean) {
+      return uint64_t(sample_size) << 32 | uint64_t(std::llround(std::ldexp(mean, MEAN_FRACTION_BITS)));
+    }
+    static inline uint32_t unpack_sample_size(uint64_t statistics) {
+      return statistics >> 32;
+    }
+    static inline double unpack_mean(uint64_t statistics) {
+      return std::ldexp(double(statistics & MEAN_MASK), -int(MEAN_FRACTION_BITS));
+    }
 
     Hash hash;
 
     friend class boost::serialization::access;
     template<class Archive>
-    inline void serialize(Archive& a, const unsigned int version) {
-      a & m_sample_size;
-      a & m_mean;
-      a & m_derivative;
+    inline void save(Archive& a, const unsigned int version) const {
+      uint64_t statistics = m_statistics;
+      double derivative = this->derivative(), variance = this->variance();
+      a & statistics;
+      a & derivative;
+      a & variance;
       a & hash;
-      a & parents;
     }
+    template<class Archive>
+    inline void load(Archive& a, const unsigned int version) {
+      uint64_t statistics;
+      double derivative, variance;
+      a & statistics;
+      a & derivative;
+      a & variance;
+      a & hash;
+      m_statistics = statistics;
+      m_derivative = derivative;
+      m_variance = pack_variance(variance);
+    }
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
 
     inline Node()
-      : m_sample_size(0),
-        m_mean(draw_value),
-        m_derivative(0)
+      : m_statistics(pack_statistics(0, draw_value)),
+        m_derivative(0),
+        m_pending(0),
+        m_edges(0),
+        m_variance(0),
+        hash(0)
     {}
 
     // serialization requires a copy constructor.
     inline Node(Node const& that)
-      : m_sample_size(that.m_sample_size),
-        m_mean(that.m_mean),
-        m_derivative(that.m_derivative),
-        parents(that.parents),
+      : m_statistics(that.m_statistics.load()),
+        m_derivative(that.m_derivative.load()),
+        m_pending(0),
+        m_edges(0),
+        m_variance(that.m_variance.load()),
         hash(that.hash)
     {}
 
-    void initialize(State const& state);
-    void adjoin_parent(Node* parent);
-    double rollout(State& state, boost::mt19937& generator);
-    inline void update(double result);
+    inline Node& operator=(Node const& that) {
+      m_statistics = that.m_statistics.load();
+      m_derivative = that.m_derivative.load();
+      m_edges = 0;
+      m_variance = that.m_variance.load();
+      hash = that.hash;
+      return *this;
+    }
+
+    void initialize(Hash hash);
+    void update(double result);
+    // keeps the sample size
+    void set_mean(double mean);
+    inline void set_statistics(uint32_t sample_size, double mean) {
+      m_statistics.store(pack_statistics(sample_size, mean), std::memory_order_relaxed);
+    }
+
+    // sample size and mean, for unpack_sample_size and unpack_mean
+    inline uint64_t statistics() const { return m_statistics.load(std::memory_order_relaxed); }
 
-    inline double sample_size() const { return m_sample_size; }
-    inline double mean() const { return m_mean; }
-    inline double derivative() const { return m_derivative; }
+    inline double sample_size() const { return unpack_sample_size(m_statistics.load(std::memory_order_relaxed)); }
+    inline double mean() const { return unpack_mean(m_statistics.load(std::memory_order_relaxed)); }
+    inline double variance() const { return unpack_variance(m_variance.load(std::memory_order_relaxed)); }
+    inline double derivative() const { return m_derivative.load(std::memory_order_relaxed); }
     inline double selection_criterion() const {
-      return m_mean + 10*m_derivative;
+      return mean() + 10*derivative();
     }
-    inline double selection_criterion(boost::mt19937& generator) const {
-      double noise = standard_normal_distribution(generator);
-      return selection_criterion() + m_derivative*noise;
+
+    inline uint32_t edges() const { return m_edges.load(std::memory_order_acquire); }
+    inline void set_edges(uint32_t edges) { m_edges.store(edges, std::memory_order_release); }
+    inline bool expanded() const { return edges() != 0; }
+
+    inline void add_virtual_loss()    { m_pending.fetch_add(1, std::memory_order_relaxed); }
+    inline void remove_virtual_loss() { m_pending.fetch_sub(1, std::memory_order_relaxed); }
+    inline double pending() const { return m_pending.load(std::memory_order_relaxed); }
+
+    // sample size counting the samples in flight, so that concurrent samplers
+    // don't all take the same new node
+    inline double effective_sample_size(VirtualLoss const& virtual_loss) const {
+      return sample_size() + (virtual_loss.mode == VirtualLoss::none ? 0 : pending());
     }
 
-    template <typename F>
-    inline void do_successors(State state, F f) {
-      std::vector<Move> moves;
-      moves::legal_moves(moves, state);
-      for (Move move: moves) {
-        Undo undo = state.make_move(move);
-        f(state, move);
-        state.unmake_move(undo);
+    inline Estimate estimate(VirtualLoss const& virtual_loss) const {
+      uint64_t statistics = m_statistics.load(std::memory_order_relaxed);
+      Estimate estimate{
+        double(unpack_sample_size(statistics)),
+        unpack_mean(statistics),
+        variance(),
+        derivative()};
+      switch (virtual_loss.mode) {
+      case VirtualLoss::none:
+        break;
+      case VirtualLoss::pessimistic: {
+        double losses = virtual_loss.value * pending();
+        if (losses > 0) {
+          estimate.mean = (estimate.sample_size*estimate.mean + losses*loss_value) / (estimate.sample_size + losses);
+          estimate.sample_size += losses;
+        }
+        break;
       }
+      case VirtualLoss::constant:
+        estimate.mean -= virtual_loss.value * pending();
+        break;
+      }
+      return estimate;
     }
 
+    // NOTE: copy-make; copying a State is cheaper than unmaking a move
     template <typename F>
-    inline void do_parents(F f) {
-      std::lock_guard<std::mutex> lock(parents_mutex);
-      for (Hash parent: parents) {
-        f(parent);
+    inline void do_successors(State const& state, F f) {
+      MoveList moves;
+      moves::legal_moves(moves, state);
+      for (Move move: moves) {
+        State successor(state);
+        successor.make_move(move);
+        f(successor, move);
       }
     }
-
-    std::string format_statistics();
   };
 
+  static_assert(sizeof(Node) <= 32, "nodes are preallocated by the million and should stay small");
+
+  // a transposition table of nodes.  a hash selects a bucket of WAYS entries
+  // whose 32-bit tags (the high half of the hash) share a cache line, so that
+  // a probe touches only that line and the node it finds; the node's full
+  // hash is then compared to rule out aliasing.  when a bucket is full, the
+  // entry to replace is one that no sample is passing through, preferably one
+  // that hasn't been used since the last call to age(), and among those the
+  // one with the fewest samples.
+  //
+  // parent links and edge lists live in arenas addressed by 32-bit indices.
+  // they are appended to without locks and freed only when the table is
+  // cleared, so a reader never sees them go away; links and edges of evicted
+  // nodes are simply abandoned.  when an arena is full, new parents go
+  // unrecorded and new nodes go unexpanded.
   class NodeTable {
-    static const size_t HASH_KEY_LENGTH = 24;
-    static const size_t HASH_KEY_CARDINALITY = 1 << HASH_KEY_LENGTH;
-    static_assert(HASH_KEY_CARDINALITY > 0, "size_t too small to contain key cardinality");
-    static const size_t HASH_KEY_MASK = HASH_KEY_CARDINALITY - 1;
+    static const size_t WAYS = 8;
+
+    // generation 0 marks an empty entry
+    typedef uint8_t Generation;
+
+    struct alignas(64) Bucket {
+      std::atomic<uint32_t> tags[WAYS];
+      std::atomic<Generation> generations[WAYS];
+      // held while replacing an entry
+      std::atomic_flag lock;
+
+      Bucket() {
+        for (size_t way = 0; way < WAYS; way++) {
+          tags[way] = 0;
+          generations[way] = 0;
+        }
+        lock.clear();
+      }
+    };
+    static_assert(sizeof(Bucket) == 64, "bucket should fill a cache line");
+
+    // an entry in a node's list of parents
+    struct ParentLink {
+      Hash parent;
+      uint32_t next;
+    };
+
+    std::vector<Bucket, boost::alignment::aligned_allocator<Bucket, 64> > buckets;
     std::vector<Node> nodes;
+    // first link in each node's list of parents
+    std::vector<std::atomic<uint32_t> > parent_lists;
+    Arena<ParentLink> parent_links;
+    // each node's edges are preceded by a header whose index is their number
+    Arena<Edge> edges_arena;
+    // all-moves-as-first statistics of each edge in edges_arena, packed as by
+    // Node::pack_statistics
+    std::vector<std::atomic<uint64_t> > amaf_statistics;
+    size_t bucket_mask;
+    Generation generation;
+    // number of nodes initialized since construction; not persistent
+    std::atomic<size_t> m_expansions;
+
+    inline size_t bucket_key(Hash hash) const { return hash & bucket_mask; }
+    static inline uint32_t tag(Hash hash) { return hash >> 32; }
+
+    // NOTE: discards all nodes
+    void allocate(size_t megabytes);
 
   public:
-    NodeTable()
-      : nodes(HASH_KEY_CARDINALITY)
+    static const size_t default_megabytes = 1024;
+
+    // the largest table that fits in the given amount of memory
+    NodeTable(size_t megabytes = default_megabytes)
+      : generation(1),
+        m_expansions(0)
     {
+      allocate(megabytes);
     }
 
-    static inline size_t key(const State& state) {
-      return key(state.hash);
-    }
+    // keeps the nodes in use, as many as fit, but not their edges
+    // NOTE: no one may be using the table meanwhile
+    void resize(size_t megabytes);
+    // NOTE: discards all nodes
+    void clear();
 
-    static inline size_t key(Hash hash) {
-      return hash & HASH_KEY_MASK;
-    }
+    inline size_t capacity() const { return nodes.size(); }
+    inline size_t expansions() const { return m_expansions; }
+
+    inline Node* at(uint32_t index) { return &nodes[index]; }
+    inline uint32_t index(Node const* node) const { return node - nodes.data(); }
 
-    Node* get(Hash hash);
+    // the node for this hash, or nullptr if there is none
+    Node* probe(Hash hash);
+    // a fresh node for this hash, evicting another if need be
+    Node* store(Hash hash);
     Node* get_or_create(State const& state);
 
+    // entries not used from now on will be the first to be replaced
+    void age();
+
+    // free every node that can't be reached from the root, and move the
+    // edges and parent links of the rest to the front of their arenas.
+    // returns the number of nodes kept.
+    // NOTE: no one may be using the table meanwhile
+    size_t collect(State const& root);
+
+    void adjoin_parent(Node const* node, Hash parent);
+    template <typename F>
+    inline void do_parents(Node const* node, F f) const {
+      for (uint32_t link = parent_lists[index(node)].load(std::memory_order_acquire);
+           link != 0;
+           link = parent_links[link].next)
+        f(parent_links[link].parent);
+    }
+    size_t count_parents(Node const* node) const;
+
+    // returns false if there is no room
+    bool set_edges(Node* node, std::vector<Edge> const& edges);
+    inline EdgeRange edges(Node const* node) const {
+      uint32_t first = node->edges();
+      if (first == 0)
+        return EdgeRange{nullptr, 0};
+      return EdgeRange{&edges_arena[first + 1], edges_arena[first].index};
+    }
+    inline std::atomic<uint64_t>& amaf(Edge const& edge) {
+      return amaf_statistics[&edge - &edges_arena[0]];
+    }
+
+    // only the nodes in use are stored, and they are stored one by one so
+    // that they can be loaded into a table of any size.
     friend class boost::serialization::access;
     template<class Archive>
-    inline void serialize(Archive& a, const unsigned int version) {
-      a & hashes::get_hashes();
+    inline void save(Archive& a, const unsigned int version) const {
+      hashes::Hashes keys = hashes::_hashes;
+      a & keys;
+      size_t count = 0;
+      for (Node const& node: nodes)
+        count += node.hash != 0;
+      a & count;
+      for (Node const& node: nodes) {
+        if (node.hash == 0)
+          continue;
+        a & node;
+        std::vector<Hash> parents;
+        do_parents(&node, [&](Hash parent) {
+            parents.push_back(parent);
+          });
+        a & parents;
+      }
+    }
+    template<class Archive>
+    inline void load(Archive& a, const unsigned int version) {
+      // the keys are fixed at compile time, so they can't be restored; check
+      // that the stored graph was built with the same ones.
+      hashes::Hashes keys;
+      a & keys;
+      if (!(keys == hashes::_hashes))
+        throw std::runtime_error("stored data uses different hash keys");
 
-      // if writing, store hash key length
-      // if reading, check hash key length
-      // need to put it into a temporary because HASH_KEY_LENGTH is const
-      size_t hash_key_length = HASH_KEY_LENGTH;
-      a & hash_key_length;
-      if (hash_key_length != HASH_KEY_LENGTH)
-        throw std::runtime_error("stored data uses different hash key length");
+      clear();
+      size_t count;
+      a & count;
+      Node node;
+      std::vector<Hash> parents;
+      for (size_t i = 0; i < count; i++) {
+        a & node;
+        a & parents;
+        // if the table is smaller than the stored one, nodes will be evicted
+        Node* stored = store(node.hash);
+        *stored = node;
+        for (Hash parent: parents)
+          adjoin_parent(stored, parent);
+      }
+    }
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
+  };
 
-      a & nodes;
+  // selection policies score the children of a node; a sample goes on to the
+  // child with the highest score.  Graph::select_child is a template on the
+  // policy, so that each gets the selection loop compiled for it.  besides
+  // score, a policy has
+  //   random_below: nodes with fewer samples choose a random move, without
+  //                 being expanded or consulting their children
+  //   forced_below: children with fewer samples, counting the ones in flight,
+  //                 are chosen without comparing scores
+  namespace policies {
+    // the parent as all policies see it, computed once per selection
+    struct Parent {
+      double sample_size, log_sample_size, sqrt_sample_size;
+
+      Parent(double sample_size)
+        : sample_size(sample_size),
+          log_sample_size(std::log(std::max(1.0, sample_size))),
+          sqrt_sample_size(std::sqrt(sample_size))
+      {}
+    };
+
+    // favors children whose mean has lately been rising, with noise on the
+    // weight of the derivative to break ties
+    struct Derivative {
+      double random_below = 30, forced_below = 10;
+      double weight = 10;
+
+      inline double score(Parent const& /*parent*/, Estimate const& child, float /*prior*/, boost::mt19937& generator) const {
+        double noise = standard_normal_distribution(generator);
+        return child.mean + (weight + noise)*child.derivative;
+      }
+    };
+
+    // UCB1 applied to trees (Kocsis and Szepesvari)
+    struct UCT {
+      double random_below = 1, forced_below = 1;
+      double exploration = std::sqrt(2.0);
+
+      inline double score(Parent const& parent, Estimate const& child, float /*prior*/, boost::mt19937& /*generator*/) const {
+        return child.mean + exploration*std::sqrt(parent.log_sample_size / std::max(1.0, child.sample_size));
+      }
+    };
+
+    // UCB1 with the exploration term scaled by an upper bound on the
+    // variance of the child's results (Auer, Cesa-Bianchi and Fischer)
+    struct UCB1Tuned {
+      double random_below = 1, forced_below = 1;
+
+      inline double score(Parent const& parent, Estimate const& child, float /*prior*/, boost::mt19937& /*generator*/) const {
+        double bound = parent.log_sample_size / std::max(1.0, child.sample_size);
+        return child.mean + std::sqrt(bound * std::min(0.25, child.variance + std::sqrt(2*bound)));
+      }
+    };
+
+    // exploration guided by the move priors, as in AlphaZero.  children are
+    // never forced; an unsampled child's mean is a draw.
+    struct PUCT {
+      double random_below = 1, forced_below = 0;
+      double exploration = 1;
+
+      inline double score(Parent const& parent, Estimate const& child, float prior, boost::mt19937& /*generator*/) const {
+        return child.mean + exploration*prior*parent.sqrt_sample_size / (1 + child.sample_size);
+      }
+    };
+  }
+
+  // which of the policies above a Graph samples with
+  enum SelectionMode {
+    selection_derivative,
+    selection_uct,
+    selection_ucb1_tuned,
+    selection_puct,
+  };
+
+  // how a sample's result reaches the nodes above it
+  enum BackpropMode {
+    // every ancestor, by way of the recorded parents
+    backprop_ancestors,
+    // only the nodes the sample was selected through
+    backprop_path,
+    // as backprop_path, and each expanded node on the path then takes the
+    // mean of its children
+    backprop_path_aggregated,
+  };
+
+  // all-moves-as-first: each edge also keeps the results of the samples in
+  // which its move was played later on by the same player, and selection
+  // blends those into the child's mean while the child has few samples of
+  // its own.
+  struct Rave {
+    bool enabled;
+    // the child's sample size at which both means weigh the same; the weight
+    // of the AMAF mean is sqrt(equivalence / (3n + equivalence)) (Gelly and
+    // Silver)
+    double equivalence;
+
+    Rave(bool enabled = false, double equivalence = 1000)
+      : enabled(enabled), equivalence(equivalence)
+    {}
+
+    inline void blend(Estimate& estimate, uint64_t amaf) const {
+      if (Node::unpack_sample_size(amaf) == 0)
+        return;
+      double weight = std::sqrt(equivalence / (3*std::max(0.0, estimate.sample_size) + equivalence));
+      estimate.mean = (1 - weight)*estimate.mean + weight*Node::unpack_mean(amaf);
+    }
+  };
+
+  // progressive widening: only the first width(n) edges of a node with n
+  // samples, best prior first, are candidates for selection, so that the
+  // node's samples aren't spread over all of its moves before any of them
+  // is known to be good.
+  struct Widening {
+    bool enabled;
+    double factor, exponent;
+
+    Widening(bool enabled = true, double factor = 1, double exponent = 0.25)
+      : enabled(enabled), factor(factor), exponent(exponent)
+    {}
+
+    inline size_t width(double sample_size) const {
+      return std::max(1.0, std::ceil(factor * std::pow(sample_size, exponent)));
+    }
+  };
+
+  // playouts that end before the game does, scored by the material balance
+  // from the perspective of the player to move when the playout started.
+  // a playout ends after max_plies, or as soon as either side is ahead by
+  // decisive_material (in pawns).
+  struct Cutoff {
+    bool enabled;
+    unsigned max_plies;
+    double decisive_material;
+    // the balance at which the expected result is 1/(1 + e^-1), about 0.73
+    double scale;
+
+    Cutoff(bool enabled = true, unsigned max_plies = 100, double decisive_material = 5, double scale = 2)
+      : enabled(enabled), max_plies(max_plies), decisive_material(decisive_material), scale(scale)
+    {}
+
+    inline double adjudicate(double balance) const {
+      return 1 / (1 + std::exp(-balance / scale));
     }
   };
 
   class Graph {
     NodeTable nodes;
+    // number of node updates by backprop; not persistent
+    std::atomic<size_t> m_updates;
+    // playouts per leaf, and the pool that runs all but one of them when
+    // there are several; the pool may be shared with other graphs
+    unsigned leaf_playouts;
+    std::shared_ptr<PlayoutPool> playout_pool;
 
   public:
+    VirtualLoss virtual_loss;
+    BackpropMode backprop_mode;
+    SelectionMode selection_mode;
+    Rave rave;
+    Widening widening;
+    Cutoff cutoff;
+    // the parameters of each policy; only that of selection_mode is used
+    policies::Derivative derivative_policy;
+    policies::UCT uct_policy;
+    policies::UCB1Tuned ucb1_tuned_policy;
+    policies::PUCT puct_policy;
+
+    Graph(size_t megabytes = NodeTable::default_megabytes);
+    ~Graph();
+
+    inline size_t expansions() const { return nodes.expansions(); }
+    inline size_t updates() const { return m_updates; }
+    inline Node* node(State const& state) { return nodes.get_or_create(state); }
+    inline EdgeRange edges(Node const* node) const { return nodes.edges(node); }
+    inline uint64_t amaf(Edge const& edge) { return nodes.amaf(edge).load(std::memory_order_relaxed); }
+    inline void age() { nodes.age(); }
+    inline size_t collect(State const& root) { return nodes.collect(root); }
+
+    // the public parameters, e.g. for graphs that sample on behalf of this one
+    inline void adopt_settings(Graph const& that) {
+      virtual_loss = that.virtual_loss;
+      backprop_mode = that.backprop_mode;
+      selection_mode = that.selection_mode;
+      rave = that.rave;
+      widening = that.widening;
+      cutoff = that.cutoff;
+      derivative_policy = that.derivative_policy;
+      uct_policy = that.uct_policy;
+      ucb1_tuned_policy = that.ucb1_tuned_policy;
+      puct_policy = that.puct_policy;
+    }
+    void merge(std::vector<Graph*> const& graphs, State const& root, unsigned depth);
+
+    // play out each new leaf this many times, on as many worker threads
+    // besides the sampling one, and backprop the mean result once, so that
+    // there are fewer updates per playout.
+    // the workers are seeded from the given generator.
+    // NOTE: not to be called while sampling
+    void set_leaf_parallelism(unsigned playouts, unsigned nworkers, boost::mt19937& generator);
+    // as above, on a pool that other graphs may be using too
+    void set_leaf_parallelism(unsigned playouts, std::shared_ptr<PlayoutPool> pool);
+    // see NodeTable::resize
+    inline void resize(size_t megabytes) { nodes.resize(megabytes); }
+
     void sample(State state, boost::mt19937& generator);
-    Node* select_child(Node* node, State& state, boost::mt19937& generator);
-    void backprop(Node* node, double initial_result);
+    template <typename Policy> void sample(State state, boost::mt19937& generator, Policy const& policy);
+    template <typename Policy> Node* select_child(Node* node, State& state, Move& move, boost::mt19937& generator, Policy const& policy);
+    double rollout(State state, boost::mt19937& generator, std::vector<Move>* moves = nullptr) const;
+    bool expand(Node* node, State const& state);
+    void backprop(std::vector<Node*> const& trajectory, double initial_result);
+    void backprop_amaf(std::vector<Node*> const& trajectory, std::vector<Move> const& moves, double initial_result);
+    void aggregate(Node* node);
     template <typename F> inline boost::optional<Move> select_successor_by(State state, F f);
     boost::optional<Move> principal_move(State state);
     void print_statistics(std::ostream& os, State state);
     void print_principal_variation(std::ostream& os, State state);
     void print_principal_variation(std::ostream& os, State state, sorted_vector<Hash>& path);
     void graphviz(std::ostream& os, Node* node, State state, boost::optional<Move> last_move);
+    std::string format_statistics(Node const* node);
 
     friend class boost::serialization::access;
     template<class Archive>
@@ -1,11 +1,20 @@
 #include "mcts_agent.hpp"
 #include "mcts.hpp"
+#include "playout_pool.hpp"
 
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 
-MCTSAgent::MCTSAgent(unsigned nponderers)
-  : pending_change(false),
+MCTSAgent::MCTSAgent(unsigned nponderers, size_t megabytes)
+  : graph(megabytes),
+    collect_garbage(true),
+    nponderers(nponderers),
+    megabytes(megabytes),
+    parallelism(shared_tree),
+    merge_interval(100),
+    merge_depth(2),
+    leaf_playouts(1),
+    pending_change(false),
     barrier_before_change(nponderers + 1),
     barrier_after_change(nponderers + 1),
     do_ponder(false),
@@ -13,9 +22,9 @@ MCTSAgent::MCTSAgent(unsigned nponderers)
 {
   for (unsigned i = 0; i < nponderers; i++) {
     auto seed = generator();
-    ponderers.create_thread([this, seed](){
+    ponderers.create_thread([this, seed, i](){
         boost::mt19937 generator(seed);
-        ponder(generator);
+        ponder(generator, i);
       });
   }
 }
@@ -25,11 +34,80 @@ MCTSAgent::~MCTSAgent() {
   ponderers.join_all();
 }
 
+void MCTSAgent::set_memory(size_t megabytes) {
+  // xboard sends "memory" before every game
+  if (megabytes == this->megabytes)
+    return;
+  between_ponderings([this, megabytes]() {
+      this->megabytes = megabytes;
+      allocate_graphs();
+    });
+}
+
+void MCTSAgent::set_parallelism(Parallelism parallelism, unsigned merge_interval_ms, unsigned merge_depth) {
+  between_ponderings([this, parallelism, merge_interval_ms, merge_depth]() {
+      this->parallelism = parallelism;
+      merge_interval = boost::chrono::milliseconds(merge_interval_ms);
+      this->merge_depth = merge_depth;
+      allocate_graphs();
+    });
+}
+
+void MCTSAgent::set_leaf_parallelism(unsigned playouts, unsigned nworkers) {
+  between_ponderings([this, playouts, nworkers]() {
+      leaf_playouts = playouts;
+      playout_pool.reset(playouts > 1 ? new PlayoutPool(nworkers, generator) : nullptr);
+      graph.set_leaf_parallelism(playouts, playout_pool);
+      for (auto& private_graph: private_graphs)
+        private_graph->set_leaf_parallelism(playouts, playout_pool);
+    });
+}
+
+void MCTSAgent::allocate_graphs() {
+  private_graphs.clear();
+  if (parallelism == shared_tree) {
+    graph.resize(megabytes);
+    return;
+  }
+  size_t share = std::max<size_t>(1, megabytes / (nponderers + 1));
+  graph.resize(share);
+  for (unsigned i = 0; i < nponderers; i++) {
+    private_graphs.emplace_back(new mcts::Graph(share));
+    private_graphs.back()->adopt_settings(graph);
+    private_graphs.back()->set_leaf_parallelism(leaf_playouts, playout_pool);
+  }
+}
+
+void MCTSAgent::reroot() {
+  if (collect_garbage)
+    graph.collect(*state);
+  graph.age();
+  for (auto& private_graph: private_graphs) {
+    if (collect_garbage)
+      private_graph->collect(*state);
+    private_graph->age();
+  }
+}
+
+void MCTSAgent::merge() {
+  std::vector<mcts::Graph*> graphs;
+  for (auto& private_graph: private_graphs)
+    graphs.push_back(private_graph.get());
+  graph.merge(graphs, *state, merge_depth);
+}
+
+void MCTSAgent::set_garbage_collection(bool collect_garbage) {
+  between_ponderings([this, collect_garbage]() {
+      this->collect_garbage = collect_garbage;
+    });
+}
+
 void MCTSAgent::set_state(State state) {
   if (state == this->state)
     return;
   between_ponderings([this, state]() {
       this->state = state;
+      reroot();
     });
 }
 
@@ -37,6 +115,7 @@ void MCTSAgent::advance_state(Move move) {
   assert(this->state);
   between_ponderings([this, move]() {
       this->state->make_move(move);
+      reroot();
     });
 }
 
@@ -52,10 +131,23 @@ void MCTSAgent::stop_pondering() {
     });
 }
 
-void MCTSAgent::ponder(boost::mt19937 generator) {
+void MCTSAgent::ponder(boost::mt19937 generator, unsigned index) {
   while (!do_terminate) {
-    perform_pondering([this, &generator]() {
-        graph.sample(*state, generator);
+    perform_pondering([this, &generator, index]() {
+        if (parallelism == shared_tree) {
+          graph.sample(*state, generator);
+          return;
+        }
+        private_graphs[index]->sample(*state, generator);
+        // the first ponderer keeps the shared graph up to date, unless a
+        // decision is being made from it, which merges for itself
+        if (index == 0 && boost::chrono::steady_clock::now() - last_merge >= merge_interval) {
+          boost::unique_lock<boost::mutex> lock(merge_mutex, boost::try_to_lock);
+          if (lock.owns_lock()) {
+            merge();
+            last_merge = boost::chrono::steady_clock::now();
+          }
+        }
       });
   }
 }
@@ -68,6 +160,10 @@ boost::future<Move> MCTSAgent::start_decision(size_t time_budget) {
   start_pondering();
   return boost::async([this, time_budget]() {
       boost::this_thread::sleep_for(boost::chrono::seconds(time_budget));
+      // merging is safe while the ponderers sample their own graphs
+      boost::lock_guard<boost::mutex> lock(merge_mutex);
+      if (parallelism == root_parallel)
+        merge();
       std::cout << "mcts result for state: " << std::endl;
       std::cout << *state << std::endl;
       std::cout << "candidate moves: " << std::endl;
@@ -2,7 +2,9 @@
 
 #include <boost/random.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/chrono.hpp>
 #include <fstream>
+#include <memory>
 
 #include "agent.hpp"
 #include "sometimes.hpp"
@@ -10,6 +12,17 @@
 #include "mcts.hpp"
 
 class MCTSAgent : Agent, boost::noncopyable {
+public:
+  enum Parallelism {
+    // the ponderers sample one graph together
+    shared_tree,
+    // each ponderer samples a graph of its own, and now and then their
+    // statistics near the root are merged into the shared one, which is
+    // what decisions are made from
+    root_parallel,
+  };
+
+private:
   boost::mt19937 generator;
   boost::thread_group ponderers;
 
@@ -17,13 +30,39 @@ class MCTSAgent : Agent, boost::noncopyable {
   bool do_terminate;
   boost::optional<State> state;
   mcts::Graph graph;
+  // whether to free the nodes that can't be reached from the new state
+  // whenever the state changes
+  bool collect_garbage;
+
+  unsigned nponderers;
+  size_t megabytes;
+  Parallelism parallelism;
+  // one per ponderer when root-parallel
+  std::vector<std::unique_ptr<mcts::Graph> > private_graphs;
+  boost::chrono::milliseconds merge_interval;
+  // number of moves from the root within which statistics are merged
+  unsigned merge_depth;
+  boost::chrono::steady_clock::time_point last_merge;
+  // held while merging into the shared graph or deciding from it, so that
+  // the first ponderer's periodic merges don't overlap the decision's
+  boost::mutex merge_mutex;
+  // for the private graphs, which are made anew when the memory changes.
+  // all of the graphs share the one pool, so that there are as many
+  // workers however many graphs sample.
+  unsigned leaf_playouts;
+  std::shared_ptr<PlayoutPool> playout_pool;
+
+  void allocate_graphs();
+  void reroot();
+  // NOTE: merge_mutex must be held
+  void merge();
 
   bool pending_change;
   boost::barrier barrier_before_change;
   boost::barrier barrier_after_change;
 
 public:
-  MCTSAgent(unsigned nponderers);
+  MCTSAgent(unsigned nponderers, size_t megabytes = mcts::NodeTable::default_megabytes);
   ~MCTSAgent();
 
   // to safely communicate with ponderers
@@ -46,12 +85,25 @@ public:
       pondering();
   }
 
+  // the graph is kept, as much of it as fits (see mcts::NodeTable::resize)
+  void set_memory(size_t megabytes);
+  // NOTE: discards the ponderers' graphs, but not the shared one.  when
+  // root-parallel, the memory is split evenly between the shared graph and
+  // the ponderers' graphs.
+  void set_parallelism(Parallelism parallelism, unsigned merge_interval_ms = 100, unsigned merge_depth = 2);
+  // see mcts::Graph::set_leaf_parallelism; all graphs share one pool of
+  // nworkers threads
+  void set_leaf_parallelism(unsigned playouts, unsigned nworkers);
+  // turn off to keep what was learned about earlier positions, e.g. when
+  // the graph is to be stored for later games
+  void set_garbage_collection(bool collect_garbage);
+
   void set_state(State state);
   void advance_state(Move move);
 
   void start_pondering();
   void stop_pondering();
-  void ponder(boost::mt19937 generator);
+  void ponder(boost::mt19937 generator, unsigned index);
 
   Move decide();
   boost::future<Move> start_decision(size_t time_budget);
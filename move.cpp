@@ -16,16 +16,6 @@ Move::Move(const int source, const int target, const MoveType type) {
   move = ((Word)type << offset_type) | (source << offset_source) | (target << offset_target);
 }
 
-Move::Move(const Move& that) :
-  move(that.move)
-{
-}
-
-Move& Move::operator=(const Move& that) {
-  this->move = that.move;
-  return *this;
-}
-
 MoveType Move::type() const { return static_cast<MoveType>((move >> offset_type) & ((1 << nbits_type) - 1)); }
 squares::Index Move::source() const { return static_cast<squares::Index>((move >> offset_source) & ((1 << nbits_source) - 1)); }
 squares::Index Move::target() const { return static_cast<squares::Index>((move >> offset_target)   & ((1 << nbits_target)   - 1)); }
@@ -74,17 +64,8 @@ bool Move::operator==(const Move& that) const { return this->move == that.move;
 bool Move::operator!=(const Move& that) const { return this->move != that.move; }
 
 Move Move::castle(Color color, Castle castle) {
-  static auto castle_moves = []() {
-    array2d<Move, colors::cardinality, castles::cardinality> result;
-    for (Color color: colors::values) {
-      for (Castle castle: castles::values) {
-        result[color][castle] = Move(king_source(color, castle), king_target(color, castle),
-                                     castle == castles::kingside ? move_types::castle_kingside : move_types::castle_queenside);
-      }
-    }
-    return result;
-  }();
-  return castle_moves[color][castle];
+  return Move(castles::king_source(color, castle), castles::king_target(color, castle),
+              castle == castles::kingside ? move_types::castle_kingside : move_types::castle_queenside);
 }
 
 std::ostream& operator<<(std::ostream& o, const Move& m) {
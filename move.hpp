@@ -23,9 +23,9 @@ public:
   Move();
   Move(Word move); // from gdb
   Move(const int source, const int target, const MoveType type);
-  Move(const Move& that);
+  Move(const Move& that) = default;
 
-  Move& operator=(const Move& that);
+  Move& operator=(const Move& that) = default;
 
   MoveType type() const;
   squares::Index source() const;
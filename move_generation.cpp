@@ -1,5 +1,6 @@
 #include <stdexcept>
 #include <cassert>
+#include <cstdlib>
 
 #include <boost/regex.hpp>
 #include <boost/optional.hpp>
@@ -9,9 +10,16 @@
 #include "targets.hpp"
 #include "state.hpp"
 
+// move generation is templated on the color to move, so that the pawn
+// directions, promotion ranks and castling squares are compile-time
+// constants.  the entry points dispatch on state.us once.
+#define DISPATCH_ON_US(state, f, ...) \
+  ((state).us == colors::white ? f<colors::white>(__VA_ARGS__) : f<colors::black>(__VA_ARGS__))
+
 // helper to generate normal or promoting moves for pawns given source and target.
-void maybe_promoting(std::vector<Move>& moves, State const& state, squares::Index source, squares::Index target, MoveType tentative_type) {
-  if (squares::bitboard(target) & targets::pawn_dingbats[state.us].promotion_rank) {
+template <Color Us>
+void maybe_promoting(MoveList& moves, squares::Index source, squares::Index target, MoveType tentative_type) {
+  if (squares::bitboard(target) & targets::pawn_dingbats[Us].promotion_rank) {
     using namespace move_types;
     if (tentative_type == capture) {
       for (MoveType type: {capturing_promotion_knight, capturing_promotion_bishop,
@@ -30,62 +38,70 @@ void maybe_promoting(std::vector<Move>& moves, State const& state, squares::Inde
 // generate normal or capturing moves based on whether targets are occupied by
 // our or their pieces.  not valid for pawns because their normal movement is
 // different from their capture movement.
-template <typename F>
-void maybe_capturing(std::vector<Move>& moves, State const& state, F source_fn, Bitboard targets) {
+template <Color Us, typename F>
+void maybe_capturing(MoveList& moves, State const& state, F source_fn, Bitboard targets) {
   squares::for_each(targets & ~state.flat_occupancy, [&](squares::Index target) {
       moves.emplace_back(source_fn(target), target, move_types::normal);
     });
-  squares::for_each(targets & state.occupancy[state.them], [&](squares::Index target) {
+  squares::for_each(targets & state.occupancy(colors::opposite(Us)), [&](squares::Index target) {
       moves.emplace_back(source_fn(target), target, move_types::capture);
     });
 }
 
 // helper to generate sliding piece moves.
-template <typename F>
-void slider_moves(std::vector<Move>& moves, State const& state, Bitboard sources, F attack_fn) {
+template <Color Us, typename F>
+void slider_moves(MoveList& moves, State const& state, Bitboard sources, F attack_fn) {
   squares::for_each(sources, [&](squares::Index source) {
-    maybe_capturing(moves, state,
-                    [&](squares::Index target) { return source; },
-                    attack_fn(source, state.flat_occupancy));
+    maybe_capturing<Us>(moves, state,
+                        [&](squares::Index target) { return source; },
+                        attack_fn(source, state.flat_occupancy));
   });
 }
 
-void moves::king_moves(std::vector<Move>& moves, State const& state, Bitboard sources) {
+template <Color Us>
+void moves::king_moves(MoveList& moves, State const& state, Bitboard sources) {
+  constexpr Color Them = colors::opposite(Us);
   squares::Index source = squares::index(sources);
-  maybe_capturing(moves, state,
-                  [&](squares::Index target) { return source; },
-                  targets::king_attacks(sources) & ~state.their_attacks);
+  maybe_capturing<Us>(moves, state,
+                      [&](squares::Index target) { return source; },
+                      targets::king_attacks(sources) & ~targets::attacks<Them>(state.flat_occupancy, state.board[Them]));
 }
 
-void moves::queen_moves(std::vector<Move>& moves, State const& state, Bitboard sources) {
-  return slider_moves(moves, state, sources, targets::queen_attacks);
+template <Color Us>
+void moves::queen_moves(MoveList& moves, State const& state, Bitboard sources) {
+  return slider_moves<Us>(moves, state, sources, targets::queen_attacks);
 }
 
-void moves::rook_moves(std::vector<Move>& moves, State const& state, Bitboard sources) {
-  return slider_moves(moves, state, sources, targets::rook_attacks);
+template <Color Us>
+void moves::rook_moves(MoveList& moves, State const& state, Bitboard sources) {
+  return slider_moves<Us>(moves, state, sources, targets::rook_attacks);
 }
 
-void moves::bishop_moves(std::vector<Move>& moves, State const& state, Bitboard sources) {
-  return slider_moves(moves, state, sources, targets::bishop_attacks);
+template <Color Us>
+void moves::bishop_moves(MoveList& moves, State const& state, Bitboard sources) {
+  return slider_moves<Us>(moves, state, sources, targets::bishop_attacks);
 }
 
-void moves::knight_moves(std::vector<Move>& moves, State const& state, Bitboard sources) {
+template <Color Us>
+void moves::knight_moves(MoveList& moves, State const& state, Bitboard sources) {
   for (targets::KnightAttackType const& ka: targets::knight_attack_types) {
-    maybe_capturing(moves, state,
-                    [&](squares::Index target) {
-                      return static_cast<squares::Index>(target - ka.direction());
-                    },
-                    ka.attacks(sources));
+    maybe_capturing<Us>(moves, state,
+                        [&](squares::Index target) {
+                          return static_cast<squares::Index>(target - ka.direction());
+                        },
+                        ka.attacks(sources));
   }
 }
 
-void moves::pawn_moves(std::vector<Move>& moves, State const& state, Bitboard sources) {
-  const targets::PawnDingbat &pd = targets::pawn_dingbats[state.us];
+template <Color Us>
+void moves::pawn_moves(MoveList& moves, State const& state, Bitboard sources) {
+  constexpr Color Them = colors::opposite(Us);
+  const targets::PawnDingbat &pd = targets::pawn_dingbats[Us];
 
   // single push
   squares::for_each(pd.single_push_targets(sources, state.flat_occupancy), [&](squares::Index target) {
       squares::Index source = static_cast<squares::Index>(target - pd.single_push_direction());
-      maybe_promoting(moves, state, source, target, move_types::normal);
+      maybe_promoting<Us>(moves, source, target, move_types::normal);
     });
 
   // double push
@@ -97,83 +113,88 @@ void moves::pawn_moves(std::vector<Move>& moves, State const& state, Bitboard so
   // captures
   for (const targets::PawnAttackType& pa: targets::pawn_attack_types) {
     signed direction = pd.leftshift - pd.rightshift + pa.leftshift - pa.rightshift;
-    squares::for_each(pawn_attacks(sources, pd, pa) & (state.occupancy[state.them] | state.en_passant_square),
+    squares::for_each(pawn_attacks(sources, pd, pa) & (state.occupancy(Them) | state.en_passant_square),
                       [&](squares::Index target) {
-                        maybe_promoting(moves, state,
-                                        static_cast<squares::Index>(target - direction),
-                                        target, move_types::capture);
+                        maybe_promoting<Us>(moves,
+                                            static_cast<squares::Index>(target - direction),
+                                            target, move_types::capture);
                       });
   }
 }
 
-void moves::castle_moves(std::vector<Move>& moves, State const& state) {
+template <Color Us>
+void moves::castle_moves(MoveList& moves, State const& state) {
   for (Castle castle: castles::values) {
-    if (state.can_castle(castle))
-      moves.push_back(Move::castle(state.us, castle));
+    if (state.can_castle<Us>(castle))
+      moves.push_back(Move::castle(Us, castle));
   }
 }
 
 // generate moves capturing the target, except from badsources
-void moves::capturing(std::vector<Move>& moves, State const& state, squares::Index target, bool to_block_check) {
+template <Color Us>
+void moves::capturing(MoveList& moves, State const& state, squares::Index target, bool to_block_check) {
   Bitboard targets = squares::bitboard(target);
 
-  Bitboard sources = targets::attackers(targets, state.flat_occupancy, state.us, state.board[state.us]);
-  sources &= ~state.board[state.us][pieces::pawn];
+  Bitboard sources = targets::attackers<Us>(targets, state.flat_occupancy, state.board[Us]);
+  sources &= ~state.board[Us][pieces::pawn];
   if (to_block_check)
-    sources &= ~state.board[state.us][pieces::king];
+    sources &= ~state.board[Us][pieces::king];
   squares::for_each(sources, [&](squares::Index source) {
       moves.emplace_back(source, target, move_types::capture);
     });
 
-  pawn_moves_capturing(moves, state, target);
+  pawn_moves_capturing<Us>(moves, state, target);
 }
 
 // generate moves that occupy the target
 // if to_block_check is true, king moves (and castles) will not be included
 // NOTE: target assumed vacant
-void moves::occupying(std::vector<Move>& moves, State const& state, squares::Index target, bool to_block_check) {
-  Bitboard sources = targets::attackers(squares::bitboard(target), state.flat_occupancy, state.us, state.board[state.us]);
-  sources &= ~state.board[state.us][pieces::pawn];
+template <Color Us>
+void moves::occupying(MoveList& moves, State const& state, squares::Index target, bool to_block_check) {
+  Bitboard sources = targets::attackers<Us>(squares::bitboard(target), state.flat_occupancy, state.board[Us]);
+  sources &= ~state.board[Us][pieces::pawn];
   if (to_block_check)
-    sources &= ~state.board[state.us][pieces::king];
+    sources &= ~state.board[Us][pieces::king];
   squares::for_each(sources, [&](squares::Index source) {
       moves.emplace_back(source, target, move_types::normal);
     });
 
-  moves::pawn_moves_occupying(moves, state, target);
+  moves::pawn_moves_occupying<Us>(moves, state, target);
 
   if (!to_block_check) {
     for (Castle castle: castles::values) {
-      if ((castles::king_target(state.us, castle) == target ||
-           castles::rook_target(state.us, castle) == target) &&
-          state.can_castle(castle))
-        moves.push_back(Move::castle(state.us, castle));
+      if ((castles::king_target(Us, castle) == target ||
+           castles::rook_target(Us, castle) == target) &&
+          state.can_castle<Us>(castle))
+        moves.push_back(Move::castle(Us, castle));
     }
   }
 }
 
 // NOTE: target assumed vacant
-void moves::pawn_moves_occupying(std::vector<Move>& moves, State const& state, squares::Index target) {
+template <Color Us>
+void moves::pawn_moves_occupying(MoveList& moves, State const& state, squares::Index target) {
   Bitboard targets = squares::bitboard(target);
 
-  const targets::PawnDingbat &pd = targets::pawn_dingbats[state.us];
+  const targets::PawnDingbat &pd = targets::pawn_dingbats[Us];
 
-  if (targets & pd.single_push_targets(state.board[state.us][pieces::pawn], state.flat_occupancy)) {
+  if (targets & pd.single_push_targets(state.board[Us][pieces::pawn], state.flat_occupancy)) {
     squares::Index source = static_cast<squares::Index>(target - pd.single_push_direction());
-    maybe_promoting(moves, state, source, target, move_types::normal);
+    maybe_promoting<Us>(moves, source, target, move_types::normal);
   }
 
-  if (targets & pd.double_push_targets(state.board[state.us][pieces::pawn], state.flat_occupancy)) {
+  if (targets & pd.double_push_targets(state.board[Us][pieces::pawn], state.flat_occupancy)) {
     squares::Index source = static_cast<squares::Index>(target - pd.double_push_direction());
-    maybe_promoting(moves, state, source, target, move_types::double_push);
+    maybe_promoting<Us>(moves, source, target, move_types::double_push);
   }
 }
 
-void moves::pawn_moves_capturing(std::vector<Move>& moves, State const& state, squares::Index target) {
+template <Color Us>
+void moves::pawn_moves_capturing(MoveList& moves, State const& state, squares::Index target) {
   Bitboard targets = squares::bitboard(target);
 
   if (state.en_passant_square) {
-    Bitboard double_pushed_pawn = state.us == colors::white
+    Bitboard double_pushed_pawn = Us == colors::white
       ? state.en_passant_square >> directions::vertical
       : state.en_passant_square << directions::vertical;
     if (targets & double_pushed_pawn) {
@@ -181,162 +202,377 @@ void moves::pawn_moves_capturing(std::vector<Move>& moves, State const& state, s
     }
   }
 
-  targets::PawnDingbat const& pd = targets::pawn_dingbats[state.us];
+  targets::PawnDingbat const& pd = targets::pawn_dingbats[Us];
   for (const targets::PawnAttackType& pa: targets::pawn_attack_types) {
     signed direction = pd.leftshift - pd.rightshift + pa.leftshift - pa.rightshift;
-    squares::for_each(pawn_attacks(state.board[state.us][pieces::pawn], pd, pa) & targets,
+    squares::for_each(pawn_attacks(state.board[Us][pieces::pawn], pd, pa) & targets,
                       [&](squares::Index target) {
                         squares::Index source = static_cast<squares::Index>(target - direction);
-                        maybe_promoting(moves, state, source, target, move_types::capture);
+                        maybe_promoting<Us>(moves, source, target, move_types::capture);
                       });
   }
 }
 
-typedef void(*MoveGenerator)(std::vector<Move>&, State const&, Bitboard);
-const static MoveGenerator piecewise_move_generators[] = {
-  moves::pawn_moves,
-  moves::knight_moves,
-  moves::bishop_moves,
-  moves::rook_moves,
-  moves::queen_moves,
-  moves::king_moves,
-};
-
 // generates pseudolegal moves.  moves that leave the king in check may be
 // generated.  the opponent's only moves will be king captures.
-void moves::moves(std::vector<Move>& moves, State const& state) {
+template <Color Us>
+void moves::moves(MoveList& moves, State const& state) {
+  using namespace pieces;
+  constexpr Color Them = colors::opposite(Us);
+
   if (state.game_definitely_over())
     return;
 
-  if (state.their_king_attacked()) {
-    moves::capturing(moves, state, squares::index(state.board[state.them][pieces::king]));
+  Halfboard const& ours = state.board[Us];
+  if (targets::any_attacked<Us>(state.board[Them][king], state.flat_occupancy, ours)) {
+    moves::capturing<Us>(moves, state, squares::index(state.board[Them][king]));
     return;
   }
 
-  moves.reserve(50);
-
-  if (state.in_check()) {
-    check_evading_moves(moves, state);
+  if (targets::any_attacked<Them>(ours[king], state.flat_occupancy, state.board[Them])) {
+    check_evading_moves<Us>(moves, state);
   } else {
-    for (Piece piece: pieces::values)
-      (*piecewise_move_generators[piece])(moves, state, state.board[state.us][piece]);
-
-    castle_moves(moves, state);
+    pawn_moves  <Us>(moves, state, ours[pawn]);
+    knight_moves<Us>(moves, state, ours[knight]);
+    bishop_moves<Us>(moves, state, ours[bishop]);
+    rook_moves  <Us>(moves, state, ours[rook]);
+    queen_moves <Us>(moves, state, ours[queen]);
+    king_moves  <Us>(moves, state, ours[king]);
+    castle_moves<Us>(moves, state);
   }
 }
 
-std::vector<Move> moves::moves(State const& state) {
-  std::vector<Move> result;
+void moves::moves(MoveList& moves, State const& state) {
+  DISPATCH_ON_US(state, moves::moves, moves, state);
+}
+
+MoveList moves::moves(State const& state) {
+  MoveList result;
   moves(result, state);
   return result;
 }
 
 // NOTE: pseudolegal
-void moves::check_evading_moves(std::vector<Move>& moves, State const& state) {
-  Bitboard bbking = state.board[state.us][pieces::king]; // hah!
+template <Color Us>
+void moves::check_evading_moves(MoveList& moves, State const& state) {
+  constexpr Color Them = colors::opposite(Us);
+  Bitboard bbking = state.board[Us][pieces::king]; // hah!
   squares::Index king = squares::index(bbking);
 
-  king_moves(moves, state, bbking);
+  king_moves<Us>(moves, state, bbking);
 
-  Bitboard attackers = targets::attackers(bbking, state.flat_occupancy, state.them, state.board[state.them]);
+  Bitboard attackers = targets::attackers<Them>(bbking, state.flat_occupancy, state.board[Them]);
   if (bitboard::cardinality(attackers) == 1) {
     squares::Index attacker = squares::index(attackers);
-    moves::capturing(moves, state, attacker, true);
+    moves::capturing<Us>(moves, state, attacker, true);
     squares::for_each(squares::in_between(attacker, king), [&](squares::Index target) {
-        moves::occupying(moves, state, target, true);
+        moves::occupying<Us>(moves, state, target, true);
       });
   }
 }
 
-void moves::legal_moves(std::vector<Move>& moves, State& state) {
-  moves::moves(moves, state);
-  erase_illegal_moves(moves, state);
+// promotion types in the order maybe_promoting generates them
+const MoveType promotion_types[2][4] = {
+  { move_types::promotion_knight, move_types::promotion_bishop,
+    move_types::promotion_rook,   move_types::promotion_queen },
+  { move_types::capturing_promotion_knight, move_types::capturing_promotion_bishop,
+    move_types::capturing_promotion_rook,   move_types::capturing_promotion_queen },
+};
+
+inline MoveType promotion_type(bool capture, int i) {
+  return promotion_types[capture][i];
 }
 
-std::vector<Move> moves::legal_moves(State& state) {
-  std::vector<Move> result;
-  legal_moves(result, state);
-  return result;
+// the legal moves of a single piece, as the set of squares it can move to
+struct PieceTargets {
+  squares::Index source;
+  bool is_pawn;
+  Bitboard targets;
+};
+
+// all legal moves in compact form: target sets by piece, plus castles and
+// en-passant captures, which don't fit that form.  a side never has more
+// than 16 pieces, two castles or two en-passant captures.
+struct LegalTargets {
+  std::array<PieceTargets, 16> pieces;
+  size_t npieces;
+  std::array<Move, 4> specials;
+  size_t nspecials;
+
+  LegalTargets() : npieces(0), nspecials(0) {}
+
+  inline void add(squares::Index source, bool is_pawn, Bitboard targets) {
+    if (!targets)
+      return;
+    assert(npieces < pieces.size());
+    pieces[npieces++] = {source, is_pawn, targets};
+  }
+
+  inline void add(Move move) {
+    assert(nspecials < specials.size());
+    specials[nspecials++] = move;
+  }
+};
+
+// the number of moves in a target set; promotions come in fours.
+template <Color Us>
+inline size_t count_moves(PieceTargets const& pt) {
+  size_t count = bitboard::cardinality(pt.targets);
+  if (pt.is_pawn)
+    count += 3 * bitboard::cardinality(pt.targets & targets::pawn_dingbats[Us].promotion_rank);
+  return count;
 }
 
-void moves::erase_illegal_moves(std::vector<Move>& moves, State& state) {
-  for (auto it = moves.begin(); it != moves.end(); ) {
-    Undo undo = state.make_move(*it);
-    if (state.their_king_attacked()) {
-      it = moves.erase(it);
-    } else {
-      it++;
-    }
-    state.unmake_move(undo);
+// NOTE: target sets never include our own pieces, so any occupied target is a
+// capture.
+inline MoveType non_promoting_type(PieceTargets const& pt, State const& state, squares::Index target) {
+  if (squares::bitboard(target) & state.flat_occupancy)
+    return move_types::capture;
+  if (pt.is_pawn && std::abs(target - pt.source) == 2*directions::vertical)
+    return move_types::double_push;
+  return move_types::normal;
+}
+
+template <Color Us, typename F>
+inline void for_each_move(PieceTargets const& pt, State const& state, F f) {
+  Bitboard promotion_rank = pt.is_pawn ? targets::pawn_dingbats[Us].promotion_rank : 0;
+  squares::for_each(pt.targets & ~promotion_rank, [&](squares::Index target) {
+      f(Move(pt.source, target, non_promoting_type(pt, state, target)));
+    });
+  squares::for_each(pt.targets & promotion_rank, [&](squares::Index target) {
+      bool capture = squares::bitboard(target) & state.flat_occupancy;
+      for (int i = 0; i < 4; i++)
+        f(Move(pt.source, target, promotion_type(capture, i)));
+    });
+}
+
+// the k-th move in the order of for_each_move
+template <Color Us>
+inline Move nth_move(PieceTargets const& pt, State const& state, size_t k) {
+  Bitboard promotion_rank = pt.is_pawn ? targets::pawn_dingbats[Us].promotion_rank : 0;
+  Bitboard ordinary = pt.targets & ~promotion_rank;
+  size_t nordinary = bitboard::cardinality(ordinary);
+  if (k < nordinary) {
+    squares::Index target = static_cast<squares::Index>(bitboard::nth_member(ordinary, k));
+    return Move(pt.source, target, non_promoting_type(pt, state, target));
   }
+  k -= nordinary;
+  squares::Index target = static_cast<squares::Index>(bitboard::nth_member(pt.targets & promotion_rank, k / 4));
+  bool capture = squares::bitboard(target) & state.flat_occupancy;
+  return Move(pt.source, target, promotion_type(capture, k % 4));
 }
 
-boost::optional<Move> moves::maybe_fast_random_move(State const& state, boost::mt19937& generator) {
-  squares::Index source = squares::random_index(state.occupancy[state.us], generator);
-  Piece piece = state.piece_at(source, state.us);
-  std::vector<Move> moves;
-  (*piecewise_move_generators[piece])(moves, state, state.board[state.us][piece]);
-  if (moves.empty())
-    return boost::none;
-  return random_element(moves, generator);
+// en-passant captures can uncover an attack on our king along the rank that
+// both pawns leave, which pins don't account for.  they are rare, so just
+// check the resulting occupancy directly.
+template <Color Us>
+void legal_en_passant_moves(LegalTargets& lt, State const& state) {
+  constexpr Color Them = colors::opposite(Us);
+  if (!state.en_passant_square)
+    return;
+
+  Bitboard king = state.board[Us][pieces::king];
+  Bitboard capture_target = Us == colors::white
+    ? state.en_passant_square >> directions::vertical
+    : state.en_passant_square << directions::vertical;
+  Halfboard remaining = state.board[Them];
+  remaining[pieces::pawn] &= ~capture_target;
+
+  for (const targets::PawnAttackType& pa: targets::pawn_attack_types) {
+    Bitboard source = targets::pawn_attacks(state.en_passant_square, targets::pawn_dingbats[Them], pa)
+      & state.board[Us][pieces::pawn];
+    if (!source)
+      continue;
+    Bitboard occupancy = (state.flat_occupancy & ~source & ~capture_target) | state.en_passant_square;
+    if (!targets::any_attacked<Them>(king, occupancy, remaining))
+      lt.add(Move(squares::index(source), squares::index(state.en_passant_square), move_types::capture));
+  }
 }
 
-boost::optional<Move> moves::random_move(State const& state, boost::mt19937& generator) {
-  if (state.game_definitely_over())
-    return boost::none;
+// computes legal moves without making them.  when in check, moves other than
+// king moves must capture the checker or block its ray, and pinned pieces may
+// only move along the line between the pinner and our king.
+// NOTE: assumes the game is not over and their king is not attacked.
+template <Color Us>
+void legal_targets(LegalTargets& lt, State const& state) {
+  using namespace pieces;
+  constexpr Color Them = colors::opposite(Us);
+
+  Halfboard const& ours   = state.board[Us];
+  Halfboard const& theirs = state.board[Them];
+  Bitboard const occupancy = state.flat_occupancy;
+  Bitboard const our_occupancy = state.occupancy(Us);
+  Bitboard const their_occupancy = occupancy & ~our_occupancy;
+  Bitboard const king = ours[pieces::king];
+  squares::Index const king_square = squares::index(king);
+
+  // the king may not step back along a checking ray, so compute their
+  // attacks as if the king weren't there
+  Bitboard king_danger = targets::attacks<Them>(occupancy & ~king, theirs);
+  lt.add(king_square, false, targets::king_attacks(king) & ~our_occupancy & ~king_danger);
+
+  Bitboard checkers = targets::attackers<Them>(king, occupancy, theirs);
+  if (bitboard::cardinality(checkers) > 1)
+    return;
 
-  // maybe_fast_random_move doesn't always find king captures if they are
-  // available.
-  if (!state.in_check() && !state.their_king_attacked()) {
-    // try the fast method a couple of times; if it fails repeatedly then there
-    // may be many pieces with no moves available to them.  then just generate
-    // all moves and select one of those.
-    for (int i = 0; i < 3; i++) {
-      boost::optional<Move> move = maybe_fast_random_move(state, generator);
-      if (move)
-        return move;
+  Bitboard check_mask = ~Bitboard(0);
+  if (checkers) {
+    check_mask = checkers | squares::in_between(squares::index(checkers), king_square);
+  } else {
+    // same as State::can_castle, but reusing king_danger, which agrees with
+    // their attacks on the castling squares when we're not in check
+    for (Castle castle: castles::values) {
+      if (state.castling_rights[Us][castle]
+          && !(castles::safe_squares(Us, castle) & king_danger)
+          && !(castles::free_squares(Us, castle) & occupancy))
+        lt.add(Move::castle(Us, castle));
     }
   }
 
-  std::vector<Move> moves;
+  // sliders that would attack our king if exactly one of our pieces were out
+  // of the way pin that piece.
+  Bitboard pinned = 0;
+  std::array<Bitboard, squares::cardinality> pin_lines;
+  Bitboard snipers =
+    (targets::bishop_attacks(king_square, their_occupancy) & (theirs[bishop] | theirs[queen])) |
+    (targets::rook_attacks  (king_square, their_occupancy) & (theirs[rook]   | theirs[queen]));
+  squares::for_each(snipers, [&](squares::Index sniper) {
+      Bitboard line = squares::in_between(sniper, king_square);
+      Bitboard blockers = line & occupancy;
+      if (bitboard::cardinality(blockers) == 1 && (blockers & our_occupancy)) {
+        pinned |= blockers;
+        pin_lines[squares::index(blockers)] = line | squares::bitboard(sniper);
+      }
+    });
+
+  Bitboard mask = ~our_occupancy & check_mask;
+  auto restricted = [&](squares::Index source, Bitboard attacks) {
+    if (pinned & squares::bitboard(source))
+      attacks &= pin_lines[source];
+    return attacks & mask;
+  };
+
+  // a pinned knight can never stay on its line
+  squares::for_each(ours[knight] & ~pinned, [&](squares::Index source) {
+      lt.add(source, false, targets::knight_attacks(squares::bitboard(source)) & mask);
+    });
+
+  squares::for_each(ours[bishop], [&](squares::Index source) {
+      lt.add(source, false, restricted(source, targets::bishop_attacks(source, occupancy)));
+    });
+
+  squares::for_each(ours[rook], [&](squares::Index source) {
+      lt.add(source, false, restricted(source, targets::rook_attacks(source, occupancy)));
+    });
+
+  squares::for_each(ours[queen], [&](squares::Index source) {
+      lt.add(source, false, restricted(source, targets::queen_attacks(source, occupancy)));
+    });
+
+  const targets::PawnDingbat &pd = targets::pawn_dingbats[Us];
+  squares::for_each(ours[pawn], [&](squares::Index source) {
+      Bitboard pawn = squares::bitboard(source);
+      Bitboard pawn_targets = pd.single_push_targets(pawn, occupancy) | pd.double_push_targets(pawn, occupancy);
+      for (const targets::PawnAttackType& pa: targets::pawn_attack_types)
+        pawn_targets |= targets::pawn_attacks(pawn, pd, pa) & their_occupancy;
+      lt.add(source, true, restricted(source, pawn_targets));
+    });
+
+  legal_en_passant_moves<Us>(lt, state);
+}
+
+template <Color Us>
+void moves::legal_moves(MoveList& moves, State const& state) {
+  if (state.game_definitely_over())
+    return;
+
+  if (targets::any_attacked<Us>(state.board[colors::opposite(Us)][pieces::king], state.flat_occupancy, state.board[Us])) {
+    // only reachable by pseudolegal play, which is what the king captures
+    // are about.
+    moves::moves<Us>(moves, state);
+    erase_illegal_moves(moves, state);
+    return;
+  }
+
+  LegalTargets lt;
+  legal_targets<Us>(lt, state);
+  for (size_t i = 0; i < lt.npieces; i++)
+    for_each_move<Us>(lt.pieces[i], state, [&](Move move) { moves.push_back(move); });
+  for (size_t i = 0; i < lt.nspecials; i++)
+    moves.push_back(lt.specials[i]);
+}
+
+void moves::legal_moves(MoveList& moves, State const& state) {
+  DISPATCH_ON_US(state, moves::legal_moves, moves, state);
+}
+
+MoveList moves::legal_moves(State const& state) {
+  MoveList result;
+  legal_moves(result, state);
+  return result;
+}
+
+void moves::erase_illegal_moves(MoveList& moves, State const& state) {
+  moves.retain([&](Move move) {
+      State successor(state);
+      successor.make_move(move);
+      return !successor.their_king_attacked();
+    });
+}
+
+// uniformly random pseudolegal move
+boost::optional<Move> moves::random_move(State const& state, boost::mt19937& generator) {
+  MoveList moves;
   moves::moves(moves, state);
   if (moves.empty())
     return boost::none;
   return random_element(moves, generator);
 }
 
-boost::optional<Move> moves::maybe_make_fast_random_legal_move(State& state, boost::mt19937& generator) {
-  boost::optional<Move> move = maybe_fast_random_move(state, generator);
-  if (!move)
-    return boost::none;
-  Undo undo = state.make_move(*move);
-  if (state.their_king_attacked()) {
-    state.unmake_move(undo);
+// uniformly random legal move.  counts the moves of each piece from its
+// target set and picks one by index, without generating the others.
+template <Color Us>
+boost::optional<Move> moves::random_legal_move(State const& state, boost::mt19937& generator) {
+  if (state.game_definitely_over())
     return boost::none;
-  } else {
-    return move;
+
+  if (targets::any_attacked<Us>(state.board[colors::opposite(Us)][pieces::king], state.flat_occupancy, state.board[Us])) {
+    MoveList moves;
+    legal_moves<Us>(moves, state);
+    if (moves.empty())
+      return boost::none;
+    return random_element(moves, generator);
   }
-}
 
-boost::optional<Move> moves::make_random_legal_move(State& state, boost::mt19937& generator) {
-  if (state.game_definitely_over())
+  LegalTargets lt;
+  legal_targets<Us>(lt, state);
+
+  std::array<size_t, 16> counts;
+  size_t total = lt.nspecials;
+  for (size_t i = 0; i < lt.npieces; i++) {
+    counts[i] = count_moves<Us>(lt.pieces[i]);
+    total += counts[i];
+  }
+  if (total == 0)
     return boost::none;
 
-  if (!state.in_check()) {
-    for (int i = 0; i < 3; i++) {
-      boost::optional<Move> move = maybe_make_fast_random_legal_move(state, generator);
-      if (move)
-        return move;
-    }
+  boost::random::uniform_int_distribution<size_t> distribution(0, total - 1);
+  size_t k = distribution(generator);
+  for (size_t i = 0; i < lt.npieces; i++) {
+    if (k < counts[i])
+      return nth_move<Us>(lt.pieces[i], state, k);
+    k -= counts[i];
   }
+  return lt.specials[k];
+}
 
-  // if no move was found, generate all legal moves and choose from there
-  std::vector<Move> moves;
-  legal_moves(moves, state);
-  if (moves.empty())
-    return boost::none;
+boost::optional<Move> moves::random_legal_move(State const& state, boost::mt19937& generator) {
+  return DISPATCH_ON_US(state, moves::random_legal_move, state, generator);
+}
 
-  Move move = random_element(moves, generator);
-  state.make_move(move);
+boost::optional<Move> moves::make_random_legal_move(State& state, boost::mt19937& generator) {
+  boost::optional<Move> move = random_legal_move(state, generator);
+  if (move)
+    state.make_move(*move);
   return move;
 }
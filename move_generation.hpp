@@ -1,7 +1,6 @@
 #pragma once
 
 #include <string>
-#include <vector>
 
 #include "bitboard.hpp"
 #include "partitions.hpp"
@@ -9,27 +8,33 @@
 #include "board.hpp"
 #include "castles.hpp"
 #include "move.hpp"
+#include "move_list.hpp"
 
+// the templates generate moves for a compile-time color to move, which must be
+// state.us; the plain functions dispatch on state.us.
 namespace moves {
-  void king_moves(std::vector<Move>& moves, State const& state, Bitboard sources);
-  void queen_moves(std::vector<Move>& moves, State const& state, Bitboard sources);
-  void rook_moves(std::vector<Move>& moves, State const& state, Bitboard sources);
-  void bishop_moves(std::vector<Move>& moves, State const& state, Bitboard sources);
-  void knight_moves(std::vector<Move>& moves, State const& state, Bitboard sources);
-  void pawn_moves(std::vector<Move>& moves, State const& state, Bitboard sources);
-  void castle_moves(std::vector<Move>& moves, State const& state);
-  void capturing(std::vector<Move>& moves, State const& state, squares::Index target, bool to_block_check = false);
-  void occupying(std::vector<Move>& moves, State const& state, squares::Index target, bool to_block_check = false);
-  void pawn_moves_occupying(std::vector<Move>& moves, State const& state, squares::Index target);
-  void pawn_moves_capturing(std::vector<Move>& moves, State const& state, squares::Index target);
-  void moves(std::vector<Move>& moves, State const& state);
-  void check_evading_moves(std::vector<Move>& moves, State const& state);
-  void legal_moves(std::vector<Move>& moves, State& state);
-  std::vector<Move> moves(State const& state);
-  std::vector<Move> legal_moves(State& state);
-  void erase_illegal_moves(std::vector<Move>& moves, State& state);
-  boost::optional<Move> maybe_fast_random_move(State const& state, boost::mt19937& generator);
+  template <Color Us> void king_moves(MoveList& moves, State const& state, Bitboard sources);
+  template <Color Us> void queen_moves(MoveList& moves, State const& state, Bitboard sources);
+  template <Color Us> void rook_moves(MoveList& moves, State const& state, Bitboard sources);
+  template <Color Us> void bishop_moves(MoveList& moves, State const& state, Bitboard sources);
+  template <Color Us> void knight_moves(MoveList& moves, State const& state, Bitboard sources);
+  template <Color Us> void pawn_moves(MoveList& moves, State const& state, Bitboard sources);
+  template <Color Us> void castle_moves(MoveList& moves, State const& state);
+  template <Color Us> void capturing(MoveList& moves, State const& state, squares::Index target, bool to_block_check = false);
+  template <Color Us> void occupying(MoveList& moves, State const& state, squares::Index target, bool to_block_check = false);
+  template <Color Us> void pawn_moves_occupying(MoveList& moves, State const& state, squares::Index target);
+  template <Color Us> void pawn_moves_capturing(MoveList& moves, State const& state, squares::Index target);
+  template <Color Us> void moves(MoveList& moves, State const& state);
+  template <Color Us> void check_evading_moves(MoveList& moves, State const& state);
+  template <Color Us> void legal_moves(MoveList& moves, State const& state);
+  template <Color Us> boost::optional<Move> random_legal_move(State const& state, boost::mt19937& generator);
+
+  void moves(MoveList& moves, State const& state);
+  void legal_moves(MoveList& moves, State const& state);
+  MoveList moves(State const& state);
+  MoveList legal_moves(State const& state);
+  void erase_illegal_moves(MoveList& moves, State const& state);
   boost::optional<Move> random_move(State const& state, boost::mt19937& generator);
-  boost::optional<Move> maybe_make_fast_random_legal_move(State& state, boost::mt19937& generator);
+  boost::optional<Move> random_legal_move(State const& state, boost::mt19937& generator);
   boost::optional<Move> make_random_legal_move(State& state, boost::mt19937& generator);
 }
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+#include "move.hpp"
+
+// fixed-capacity list of moves that lives on the stack, so that generating
+// moves doesn't touch the heap.  no position has more than 218 legal moves,
+// and pseudolegal generation stays well below the capacity.
+class MoveList {
+public:
+  static const size_t capacity = 256;
+
+private:
+  size_t count;
+  // in a union so that constructing a list doesn't construct its moves
+  union {
+    Move moves[capacity];
+  };
+
+public:
+  typedef Move value_type;
+  typedef Move* iterator;
+  typedef Move const* const_iterator;
+
+  inline MoveList() : count(0) {}
+
+  inline MoveList(MoveList const& that) : count(that.count) {
+    std::copy(that.begin(), that.end(), begin());
+  }
+
+  inline MoveList& operator=(MoveList const& that) {
+    count = that.count;
+    std::copy(that.begin(), that.end(), begin());
+    return *this;
+  }
+
+  inline iterator begin() { return moves; }
+  inline iterator end() { return moves + count; }
+  inline const_iterator begin() const { return moves; }
+  inline const_iterator end() const { return moves + count; }
+
+  inline size_t size() const { return count; }
+  inline bool empty() const { return count == 0; }
+  inline void clear() { count = 0; }
+
+  inline Move& operator[](size_t i) { assert(i < count); return moves[i]; }
+  inline Move const& operator[](size_t i) const { assert(i < count); return moves[i]; }
+
+  inline void push_back(Move const& move) {
+    assert(count < capacity);
+    moves[count++] = move;
+  }
+
+  template <typename... Args>
+  inline void emplace_back(Args&&... args) {
+    assert(count < capacity);
+    moves[count++] = Move(std::forward<Args>(args)...);
+  }
+
+  // keep only the moves that satisfy the predicate, preserving their order
+  template <typename F>
+  inline void retain(F predicate) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (predicate(moves[i]))
+        moves[kept++] = moves[i];
+    }
+    count = kept;
+  }
+};
@@ -51,15 +51,8 @@ Move notation::algebraic::parse(std::string string, const State& state) {
     };
   }
 
-  std::vector<Move> candidates = moves::moves(state);
-
-  for (auto it = candidates.begin(); it != candidates.end(); ) {
-    if (!predicate(*it)) {
-      it = candidates.erase(it);
-    } else {
-      it++;
-    }
-  }
+  MoveList candidates = moves::moves(state);
+  candidates.retain(predicate);
 
   if (candidates.empty())
     throw OverdeterminedException(str(boost::format("no match for algebraic move: %1%") % string));
@@ -34,19 +34,27 @@
     return _by_keyword.at(keyword);
   }
 
+  // computed at compile time, so there's no initialization to wait for
+  struct BitboardTable {
+    Bitboard bitboards[cardinality];
+  };
+
+  constexpr BitboardTable make_bitboard_table() {
+    BitboardTable table = {};
+    for (int i = 0; i < int(cardinality); i++)
+      table.bitboards[i] = PARTITION_BITBOARD(i);
+    return table;
+  }
+
+  constexpr BitboardTable _bitboards = make_bitboard_table();
+
   __attribute__((always_inline))
-  inline Bitboard bitboard(Index i) {
-    static auto bitboards = [](){
-      std::array<Bitboard, cardinality> bitboards;
-      for (Index i: indices)
-        bitboards[i] = PARTITION_BITBOARD(i);
-      return bitboards;
-    }();
-    return bitboards[i];
+  constexpr inline Bitboard bitboard(Index i) {
+    return _bitboards.bitboards[i];
   }
 
   namespace bitboards {
-#define _(key) const Bitboard key = bitboard(PARTITION_NAMESPACE::key);
+#define _(key) constexpr Bitboard key = PARTITION_NAMESPACE::bitboard(PARTITION_NAMESPACE::key);
       PARTITION_KEYWORDS
 #undef _
   }
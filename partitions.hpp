@@ -20,7 +20,7 @@ namespace squares {
   _(a6) _(b6) _(c6) _(d6) _(e6) _(f6) _(g6) _(h6) \
   _(a7) _(b7) _(c7) _(d7) _(e7) _(f7) _(g7) _(h7) \
   _(a8) _(b8) _(c8) _(d8) _(e8) _(f8) _(g8) _(h8)
-#define PARTITION_BITBOARD(i) (Bitboard(1) << (i));
+#define PARTITION_BITBOARD(i) (Bitboard(1) << (i))
 
 #include "partition_template.hpp"
 
@@ -54,57 +54,71 @@ namespace squares {
     return false;
   }
 
-  inline Bitboard in_between(Index a, Index b) {
-    // from https://chessprogramming.wikispaces.com/Square+Attacked+By#Obstructed
-    // haven't taken the time to understand
-    auto in_between_fn = [](Index sq1, Index sq2) {
-      const Bitboard m1   = Bitboard(-1);
-      const Bitboard a2a7 = Bitboard(0x0001010101010100);
-      const Bitboard b2g7 = Bitboard(0x0040201008040200);
-      const Bitboard h1b7 = Bitboard(0x0002040810204080); /* Thanks Dustin, g2b7 did not work for c1-a3 */
-      Bitboard btwn, line, rank, file;
- 
-      btwn  = (m1 << sq1) ^ (m1 << sq2);
-      file  =   (sq2 & 7) - (sq1   & 7);
-      rank  =  ((sq2 | 7) -  sq1) >> 3 ;
-      line  =      (   (file  &  7) - 1) & a2a7; /* a2a7 if same file */
-      line += 2 * ((   (rank  &  7) - 1) >> 58); /* b1g1 if same rank */
-      line += (((rank - file) & 15) - 1) & b2g7; /* b2g7 if same diagonal */
-      line += (((rank + file) & 15) - 1) & h1b7; /* h1b7 if same antidiag */
-      line *= btwn & -btwn; /* mul acts like shift by smaller square */
-      return line & btwn;   /* return the bits on that line in-between */
-    };
-
-    static auto _in_between = [&]() {
-      array2d<Bitboard, cardinality, cardinality> result;
-      for (Index a: indices)
-        for (Index b: indices)
-          result[a][b] = in_between_fn(a, b);
-      return result;
-    }();
-    return _in_between[a][b];
+  // from https://chessprogramming.wikispaces.com/Square+Attacked+By#Obstructed
+  // haven't taken the time to understand
+  constexpr Bitboard in_between_fn(int sq1, int sq2) {
+    const Bitboard m1   = Bitboard(-1);
+    const Bitboard a2a7 = Bitboard(0x0001010101010100);
+    const Bitboard b2g7 = Bitboard(0x0040201008040200);
+    const Bitboard h1b7 = Bitboard(0x0002040810204080); /* Thanks Dustin, g2b7 did not work for c1-a3 */
+    Bitboard btwn = 0, line = 0, rank = 0, file = 0;
+
+    btwn  = (m1 << sq1) ^ (m1 << sq2);
+    file  =   (sq2 & 7) - (sq1   & 7);
+    rank  =  ((sq2 | 7) -  sq1) >> 3 ;
+    line  =      (   (file  &  7) - 1) & a2a7; /* a2a7 if same file */
+    line += 2 * ((   (rank  &  7) - 1) >> 58); /* b1g1 if same rank */
+    line += (((rank - file) & 15) - 1) & b2g7; /* b2g7 if same diagonal */
+    line += (((rank + file) & 15) - 1) & h1b7; /* h1b7 if same antidiag */
+    line *= btwn & -btwn; /* mul acts like shift by smaller square */
+    return line & btwn;   /* return the bits on that line in-between */
+  }
+
+  struct InBetweenTable {
+    Bitboard in_between[cardinality][cardinality];
+  };
+
+  constexpr InBetweenTable make_in_between_table() {
+    InBetweenTable table = {};
+    for (int a = 0; a < int(cardinality); a++)
+      for (int b = 0; b < int(cardinality); b++)
+        table.in_between[a][b] = in_between_fn(a, b);
+    return table;
+  }
+
+  constexpr InBetweenTable _in_between = make_in_between_table();
+
+  constexpr inline Bitboard in_between(Index a, Index b) {
+    return _in_between.in_between[a][b];
   }
 }
 
 // the partitions below all need to have this procedure to look up a part by square index
 #define BY_SQUARE(spacename) \
-  __attribute__((always_inline)) \
-  inline Index by_square(squares::Index si) { \
-    static auto by_square = [](){ \
-      std::array<Index, squares::cardinality> by_square; \
-      for (squares::Index si: squares::indices) { \
-        for (Index i: indices) { \
-          if (squares::bitboard(si) & bitboard(i)) \
-            by_square[si] = i; \
-        } \
+  struct BySquareTable { \
+    Index by_square[squares::cardinality]; \
+  }; \
+  \
+  constexpr BySquareTable make_by_square_table() { \
+    BySquareTable table = {}; \
+    for (int si = 0; si < int(squares::cardinality); si++) { \
+      for (int i = 0; i < int(cardinality); i++) { \
+        if (squares::bitboard(static_cast<squares::Index>(si)) & bitboard(static_cast<Index>(i))) \
+          table.by_square[si] = static_cast<Index>(i); \
       } \
-      return by_square; \
-    }(); \
-    return by_square[si]; \
+    } \
+    return table; \
+  } \
+  \
+  constexpr BySquareTable _by_square = make_by_square_table(); \
+  \
+  __attribute__((always_inline)) \
+  constexpr inline Index by_square(squares::Index si) { \
+    return _by_square.by_square[si]; \
   } \
   \
   namespace bitboards { \
-    inline Bitboard by_square(squares::Index si) { \
+    constexpr inline Bitboard by_square(squares::Index si) { \
       return bitboard(spacename::by_square(si)); \
     } \
   }
@@ -131,11 +145,9 @@ namespace diagonals {
 #define PARTITION_NAMESPACE diagonals
 #define PARTITION_CARDINALITY 15
 #define PARTITION_KEYWORDS _(h8h8) _(g8h7) _(f8h6) _(e8h5) _(d8h4) _(c8h3) _(b8h2) _(a8h1) _(a7g1) _(a6f1) _(a5e1) _(a4d1) _(a3c1) _(a2b1) _(a1a1)
-#define PARTITION_BITBOARD(i) ([&i](){ \
-  Bitboard maindiagonal = Bitboard(0x0102040810204080); \
-  int shiftcount = (7 - i)*directions::vertical; \
-  return shiftcount >= 0 ? maindiagonal >> shiftcount : maindiagonal << -shiftcount; \
-})()
+#define PARTITION_BITBOARD(i) ((7 - (i)) >= 0 \
+  ? Bitboard(0x0102040810204080) >> (7 - (i))*directions::vertical \
+  : Bitboard(0x0102040810204080) << ((i) - 7)*directions::vertical)
 #include "partition_template.hpp"
 BY_SQUARE(diagonals)
 }
@@ -144,11 +156,9 @@ namespace giadonals {
 #define PARTITION_NAMESPACE giadonals
 #define PARTITION_CARDINALITY 15
 #define PARTITION_KEYWORDS _(a8a8) _(a7b8) _(a6c8) _(a5d8) _(a4e8) _(a3f8) _(a2g8) _(a1h8) _(b1h7) _(c1h6) _(d1h5) _(e1h4) _(f1h3) _(g1h2) _(h1h1)
-#define PARTITION_BITBOARD(i) ([&i](){ \
-  Bitboard maingiadonal = Bitboard(0x8040201008040201); \
-  int shiftcount = (7 - i)*directions::vertical; \
-  return shiftcount >= 0 ? maingiadonal << shiftcount : maingiadonal >> -shiftcount; \
-})()
+#define PARTITION_BITBOARD(i) ((7 - (i)) >= 0 \
+  ? Bitboard(0x8040201008040201) << (7 - (i))*directions::vertical \
+  : Bitboard(0x8040201008040201) >> ((i) - 7)*directions::vertical)
 #include "partition_template.hpp"
 BY_SQUARE(giadonals)
 }
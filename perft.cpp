@@ -0,0 +1,247 @@
+#include <ios>
+#include <atomic>
+#include <fstream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+#include <boost/thread.hpp>
+
+#include "state.hpp"
+#include "notation.hpp"
+
+#define fmt boost::format
+
+// counts the leaves of the legal move tree to a given depth, to check move
+// generation against known results and to measure its speed.  see
+// https://chessprogramming.wikispaces.com/Perft+Results
+//
+// NOTE: State treats positions with halfmove_clock >= 50 as drawn and
+// generates no moves in them, so very deep trees may come up short.
+
+// caches subtree counts by position and depth.  entries are written without
+// locks; the key is stored xored with the data so that an entry torn by
+// concurrent writers fails verification instead of returning a wrong count.
+class PerftTable {
+  struct Entry {
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> data;
+  };
+  std::vector<Entry> entries;
+  size_t mask;
+
+public:
+  PerftTable(size_t megabytes) {
+    size_t size = 1;
+    while (2 * size * sizeof(Entry) <= megabytes << 20)
+      size *= 2;
+    entries = std::vector<Entry>(size);
+    mask = size - 1;
+    for (Entry& entry: entries) {
+      entry.key = 0;
+      entry.data = 0;
+    }
+  }
+
+  inline bool probe(Hash hash, unsigned depth, uint64_t& count) {
+    Entry& entry = entries[hash & mask];
+    uint64_t data = entry.data.load(std::memory_order_relaxed);
+    uint64_t key = entry.key.load(std::memory_order_relaxed);
+    if ((key ^ data) != hash || (data & 0xff) != depth)
+      return false;
+    count = data >> 8;
+    return true;
+  }
+
+  inline void store(Hash hash, unsigned depth, uint64_t count) {
+    Entry& entry = entries[hash & mask];
+    uint64_t data = count << 8 | depth;
+    entry.key.store(hash ^ data, std::memory_order_relaxed);
+    entry.data.store(data, std::memory_order_relaxed);
+  }
+};
+
+uint64_t perft(State& state, unsigned depth, PerftTable* table) {
+  if (depth == 0)
+    return 1;
+
+  uint64_t count;
+  if (depth > 1 && table && table->probe(state.hash, depth, count))
+    return count;
+
+  MoveList moves;
+  moves::legal_moves(moves, state);
+  // bulk counting: the leaves are exactly the legal moves, no need to make them
+  if (depth == 1)
+    return moves.size();
+
+  count = 0;
+  for (Move move: moves) {
+    Undo undo = state.make_move(move);
+    count += perft(state, depth - 1, table);
+    state.unmake_move(undo);
+  }
+
+  if (table)
+    table->store(state.hash, depth, count);
+  return count;
+}
+
+// counts the subtree under each root move, with root moves handed out to
+// nthreads threads.
+std::vector<uint64_t> divide(State const& state, MoveList const& moves, unsigned depth,
+                             PerftTable* table, unsigned nthreads) {
+  assert(depth > 0);
+  std::vector<uint64_t> counts(moves.size());
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    State child(state);
+    for (size_t i = next++; i < moves.size(); i = next++) {
+      Undo undo = child.make_move(moves[i]);
+      counts[i] = perft(child, depth - 1, table);
+      child.unmake_move(undo);
+    }
+  };
+  boost::thread_group threads;
+  for (unsigned i = 1; i < nthreads; i++)
+    threads.create_thread(work);
+  work();
+  threads.join_all();
+  return counts;
+}
+
+uint64_t run(std::ostream& out, State state, unsigned depth, bool print_divide,
+             PerftTable* table, unsigned nthreads) {
+  auto then = std::chrono::high_resolution_clock::now();
+
+  MoveList moves;
+  moves::legal_moves(moves, state);
+  uint64_t count;
+  if (depth == 0) {
+    count = 1;
+  } else if (print_divide || nthreads > 1) {
+    std::vector<uint64_t> counts = divide(state, moves, depth, table, nthreads);
+    count = 0;
+    for (size_t i = 0; i < moves.size(); i++) {
+      if (print_divide)
+        out << notation::coordinate::format(moves[i]) << ": " << counts[i] << std::endl;
+      count += counts[i];
+    }
+  } else {
+    count = perft(state, depth, table);
+  }
+
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - then);
+  out << fmt("depth %1% nodes %2% time %3%ms nps %4%")
+    % depth
+    % count
+    % (duration.count() / 1000)
+    % (uint64_t)(count * 1e6 / std::max<int64_t>(duration.count(), 1))
+      << std::endl;
+  return count;
+}
+
+// EPD perft suites have lines like
+//   rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - ;D1 20 ;D2 400
+// where the FEN may lack the move counters.  returns whether all counts up to
+// max_depth match.
+bool run_epd(std::ostream& out, std::string path, unsigned max_depth, bool print_divide,
+             PerftTable* table, unsigned nthreads) {
+  std::ifstream in(path);
+  if (!in)
+    throw std::runtime_error(str(fmt("can't read EPD file: %1%") % path));
+
+  bool all_passed = true;
+  std::string line;
+  while (std::getline(in, line)) {
+    boost::algorithm::trim(line);
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::vector<std::string> fields;
+    boost::algorithm::split(fields, line, boost::algorithm::is_any_of(";"));
+    std::string fen = boost::algorithm::trim_copy(fields[0]);
+    if (words(fen).size() == 4)
+      fen += " 0 1";
+    State state(fen);
+    out << fen << std::endl;
+
+    for (size_t i = 1; i < fields.size(); i++) {
+      std::vector<std::string> operands = words(fields[i]);
+      if (operands.size() != 2 || operands[0].size() < 2 || operands[0][0] != 'D')
+        throw std::runtime_error(str(fmt("can't parse EPD perft operation \"%1%\" in line: %2%") % fields[i] % line));
+      unsigned depth = std::stoi(operands[0].substr(1));
+      uint64_t expected = std::stoull(operands[1]);
+      if (depth > max_depth)
+        continue;
+      uint64_t count = run(out, state, depth, print_divide, table, nthreads);
+      if (count != expected) {
+        out << fmt("FAIL: expected %1% nodes at depth %2%") % expected % depth << std::endl;
+        all_passed = false;
+      }
+    }
+  }
+  return all_passed;
+}
+
+void usage(std::ostream& out) {
+  out << "usage: perft [options] <depth> [<fen>]" << std::endl
+      << "       perft [options] --epd <path> [<max depth>]" << std::endl
+      << "options:" << std::endl
+      << "  --divide       print the node count under each root move" << std::endl
+      << "  --hash <MB>    cache subtree counts in a table of this size" << std::endl
+      << "  --threads <n>  split the root moves across n threads" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  std::ostream& out = std::cout;
+
+  bool print_divide = false;
+  size_t hash_megabytes = 0;
+  unsigned nthreads = 1;
+  boost::optional<std::string> epd_path;
+  std::vector<std::string> positional;
+
+  try {
+    for (int i = 1; i < argc; i++) {
+      std::string arg(argv[i]);
+      auto operand = [&]() {
+        if (++i >= argc)
+          throw std::runtime_error("missing operand for " + arg);
+        return std::string(argv[i]);
+      };
+      if (arg == "--divide")       print_divide = true;
+      else if (arg == "--hash")    hash_megabytes = std::stoul(operand());
+      else if (arg == "--threads") nthreads = std::stoul(operand());
+      else if (arg == "--epd")     epd_path = operand();
+      else if (arg == "--help")    { usage(out); return 0; }
+      else                         positional.push_back(arg);
+    }
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    usage(std::cerr);
+    return 2;
+  }
+
+  if (nthreads < 1)
+    nthreads = 1;
+
+  std::unique_ptr<PerftTable> table;
+  if (hash_megabytes > 0)
+    table.reset(new PerftTable(hash_megabytes));
+
+  if (epd_path) {
+    unsigned max_depth = positional.empty() ? 1000 : std::stoi(positional[0]);
+    return run_epd(out, *epd_path, max_depth, print_divide, table.get(), nthreads) ? 0 : 1;
+  }
+
+  if (positional.empty()) {
+    usage(std::cerr);
+    return 2;
+  }
+  unsigned depth = std::stoi(positional[0]);
+  State state;
+  if (positional.size() > 1)
+    state = State(boost::algorithm::join(std::vector<std::string>(positional.begin() + 1, positional.end()), " "));
+  run(out, state, depth, print_divide, table.get(), nthreads);
+  return 0;
+}
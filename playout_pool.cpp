@@ -0,0 +1,74 @@
+#include "playout_pool.hpp"
+
+#include <algorithm>
+
+PlayoutPool::PlayoutPool(unsigned nworkers, boost::mt19937& generator)
+  : terminate(false)
+{
+  for (unsigned i = 0; i < nworkers; i++) {
+    auto worker_seed = generator();
+    workers.create_thread([this, worker_seed]() {
+        work(boost::mt19937(worker_seed));
+      });
+  }
+}
+
+PlayoutPool::~PlayoutPool() {
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    terminate = true;
+    work_available.notify_all();
+  }
+  workers.join_all();
+}
+
+PlayoutPool::Batch* PlayoutPool::claim() {
+  if (batches.empty())
+    return nullptr;
+  Batch* batch = batches.front();
+  if (--batch->unclaimed == 0)
+    batches.pop_front();
+  return batch;
+}
+
+void PlayoutPool::work(boost::mt19937 generator) {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  while (true) {
+    while (!terminate && batches.empty())
+      work_available.wait(lock);
+    if (terminate)
+      return;
+    Batch* batch = claim();
+    lock.unlock();
+    double result = (*batch->playout)(generator);
+    lock.lock();
+    batch->total += result;
+    if (--batch->unfinished == 0)
+      batch_finished.notify_all();
+  }
+}
+
+double PlayoutPool::total(unsigned n, Playout const& playout, boost::mt19937& generator) {
+  if (n == 0)
+    return 0;
+  Batch batch{&playout, n, n, 0};
+  boost::unique_lock<boost::mutex> lock(mutex);
+  batches.push_back(&batch);
+  work_available.notify_all();
+  // help out until all of the batch has been taken; other batches are left
+  // to the workers
+  while (batch.unclaimed > 0) {
+    // the batch is still queued, but maybe not at the front
+    auto it = std::find(batches.begin(), batches.end(), &batch);
+    if (--batch.unclaimed == 0)
+      batches.erase(it);
+    lock.unlock();
+    double result = playout(generator);
+    lock.lock();
+    batch.total += result;
+    batch.unfinished--;
+  }
+  while (batch.unfinished > 0)
+    batch_finished.wait(lock);
+  return batch.total;
+}
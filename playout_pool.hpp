@@ -0,0 +1,47 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <boost/thread.hpp>
+#include <boost/random.hpp>
+#include <boost/noncopyable.hpp>
+
+// a fixed set of threads that run batches of independent playouts, each
+// thread with a generator of its own.  several callers may submit batches at
+// once; the workers take playouts from the oldest batch first.
+class PlayoutPool : boost::noncopyable {
+public:
+  typedef std::function<double(boost::mt19937&)> Playout;
+
+private:
+  struct Batch {
+    Playout const* playout;
+    // playouts not yet taken by a thread, and not yet finished
+    unsigned unclaimed, unfinished;
+    double total;
+  };
+
+  boost::thread_group workers;
+  boost::mutex mutex;
+  boost::condition_variable work_available;
+  boost::condition_variable batch_finished;
+  std::deque<Batch*> batches;
+  bool terminate;
+
+  // claims a playout of the batch at the front, or returns nullptr if there
+  // is none.  NOTE: the lock must be held
+  Batch* claim();
+  void work(boost::mt19937 generator);
+
+public:
+  // the workers' generators are seeded from the given one, so that pools
+  // made with different generators play different playouts
+  PlayoutPool(unsigned nworkers, boost::mt19937& generator);
+  ~PlayoutPool();
+
+  // runs n playouts and returns the sum of their results.  the calling
+  // thread runs playouts of its own batch too, with the given generator,
+  // rather than wait idly.
+  double total(unsigned n, Playout const& playout, boost::mt19937& generator);
+};
@@ -14,6 +14,9 @@ int main(int argc, char* argv[]) {
   State state;
   MCTSAgent agent(2);
 
+  // what is stored should cover the whole game
+  if (path_to_storage)
+    agent.set_garbage_collection(false);
   if (path_to_storage && file_readable(*path_to_storage))
     agent.load_yourself(*path_to_storage);
 
@@ -21,6 +21,7 @@ struct sorted_vector {
   inline const_iterator end() const { return V.end(); }
 
   inline size_t size() { return V.size(); }
+  inline void clear() { V.clear(); }
 
   inline sorted_vector(Compare const& c = Compare())
   : V(), cmp(c)
@@ -1,20 +1,289 @@
 #include <ios>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 
 #include "move.hpp"
 #include "state.hpp"
+#include "magics.hpp"
 #include "mcts_agent.hpp"
 
+// count heap allocations so we can tell whether the sampling loop does any
+std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+  allocations++;
+  void* pointer = std::malloc(size);
+  if (!pointer)
+    throw std::bad_alloc();
+  return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  std::free(pointer);
+}
+
+template <typename F>
+void time_slider_attacks(std::string name, std::vector<Bitboard> const& occupancies, F attacks) {
+  // accumulate the results so the lookups can't be optimized away
+  Bitboard sink = 0;
+  auto then = std::chrono::high_resolution_clock::now();
+  for (Bitboard occupancy: occupancies)
+    for (squares::Index source: squares::indices)
+      sink ^= attacks(source, occupancy);
+  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+  std::cout << name << " " << duration.count() << " (" << (sink & 1) << ")" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
-  std::cout << "cumulative sampling durations for initial state:" << std::endl;
+  std::cout << "slider attack durations for " << 1e5 * squares::cardinality << " queen lookups (backend: " << magics::backend() << "):" << std::endl;
+  {
+    boost::mt19937 generator;
+    boost::random::uniform_int_distribution<Bitboard> distribution;
+    std::vector<Bitboard> occupancies(1e5);
+    for (Bitboard& occupancy: occupancies)
+      occupancy = distribution(generator) & distribution(generator);
+    time_slider_attacks("hyperbola", occupancies, [](squares::Index source, Bitboard occupancy) {
+        return targets::hyperbola_bishop_attacks(source, occupancy) | targets::hyperbola_rook_attacks(source, occupancy);
+      });
+    time_slider_attacks("tables", occupancies, [](squares::Index source, Bitboard occupancy) {
+        return magics::bishop_attacks(source, occupancy) | magics::rook_attacks(source, occupancy);
+      });
+  }
+
+  std::cout << "move generation durations for positions along random games:" << std::endl;
+  {
+    boost::mt19937 generator;
+    std::vector<State> states;
+    while (states.size() < 1e4) {
+      State state;
+      while (!state.game_definitely_over() && states.size() < 1e4) {
+        states.push_back(state);
+        if (!moves::make_random_legal_move(state, generator))
+          break;
+      }
+    }
+    size_t nmoves = 0;
+    auto then = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < 10; i++)
+      for (State const& state: states)
+        nmoves += moves::moves(state).size();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+    std::cout << 10 * states.size() << " positions, " << nmoves << " moves, " << duration.count() << std::endl;
+
+    // visit every legal successor of every position, either by making and
+    // unmaking each move in place or by making it on a copy
+    std::cout << "successor visiting durations (make/unmake, copy-make; sizeof(State) = " << sizeof(State) << "):" << std::endl;
+    std::vector<MoveList> moves(states.size());
+    for (size_t i = 0; i < states.size(); i++)
+      moves::legal_moves(moves[i], states[i]);
+    Hash sink = 0;
+    then = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < 10; i++) {
+      for (size_t j = 0; j < states.size(); j++) {
+        State& state = states[j];
+        for (Move move: moves[j]) {
+          Undo undo = state.make_move(move);
+          sink ^= state.hash;
+          state.unmake_move(undo);
+        }
+      }
+    }
+    duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+    std::cout << "make/unmake " << duration.count() << " (" << (sink & 1) << ")" << std::endl;
+    then = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < 10; i++) {
+      for (size_t j = 0; j < states.size(); j++) {
+        for (Move move: moves[j]) {
+          State successor(states[j]);
+          successor.make_move(move);
+          sink ^= successor.hash;
+        }
+      }
+    }
+    duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+    std::cout << "copy-make " << duration.count() << " (" << (sink & 1) << ")" << std::endl;
+  }
+
+  std::cout << "random playouts from initial state (playouts, plies, milliseconds, allocations per ply):" << std::endl;
+  {
+    boost::mt19937 generator;
+    size_t plies = 0;
+    size_t allocations0 = allocations;
+    auto then = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < 1e3; i++) {
+      State state;
+      while (moves::make_random_legal_move(state, generator))
+        plies++;
+    }
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+    std::cout << 1e3 << " " << plies << " " << duration.count() << " " << double(allocations - allocations0) / plies << std::endl;
+  }
+
+  // threads share one graph, as the ponderers do.  unique nodes expanded
+  // rather than samples is what tells whether virtual loss keeps the threads
+  // out of each other's way.
+  std::cout << "parallel sampling for initial state (virtual loss, threads, samples, samples per second, nodes expanded per second):" << std::endl;
+  {
+    std::vector<std::pair<std::string, mcts::VirtualLoss> > virtual_losses = {
+      {"none", mcts::VirtualLoss(mcts::VirtualLoss::none)},
+      {"pessimistic", mcts::VirtualLoss(mcts::VirtualLoss::pessimistic, 1)},
+      {"constant", mcts::VirtualLoss(mcts::VirtualLoss::constant, 0.1)},
+    };
+    for (auto const& virtual_loss: virtual_losses) {
+      for (unsigned nthreads = 1; nthreads <= 16; nthreads *= 2) {
+        std::unique_ptr<mcts::Graph> graph(new mcts::Graph());
+        graph->virtual_loss = virtual_loss.second;
+        std::atomic<size_t> samples(0);
+        std::atomic<bool> done(false);
+        boost::thread_group threads;
+        auto then = std::chrono::high_resolution_clock::now();
+        for (unsigned i = 0; i < nthreads; i++) {
+          threads.create_thread([&, i]() {
+              boost::mt19937 generator(i);
+              State state;
+              while (!done) {
+                graph->sample(state, generator);
+                samples++;
+              }
+            });
+        }
+        boost::this_thread::sleep_for(boost::chrono::seconds(2));
+        done = true;
+        threads.join_all();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+        std::cout << virtual_loss.first << " " << nthreads << " " << samples
+                  << " " << samples * 1e3 / duration.count()
+                  << " " << graph->expansions() * 1e3 / duration.count() << std::endl;
+      }
+    }
+  }
+
+  // each thread samples a graph of its own, and the first merges them into a
+  // combined one every 100ms, as root-parallel ponderers do.  nothing is
+  // written to shared memory between merges.
+  std::cout << "root-parallel sampling for initial state (threads, samples, samples per second):" << std::endl;
+  {
+    for (unsigned nthreads = 1; nthreads <= 16; nthreads *= 2) {
+      std::vector<std::unique_ptr<mcts::Graph> > graphs;
+      std::vector<mcts::Graph*> sources;
+      for (unsigned i = 0; i < nthreads; i++) {
+        graphs.emplace_back(new mcts::Graph(mcts::NodeTable::default_megabytes / (nthreads + 1)));
+        sources.push_back(graphs.back().get());
+      }
+      std::unique_ptr<mcts::Graph> combined(new mcts::Graph(mcts::NodeTable::default_megabytes / (nthreads + 1)));
+      std::atomic<bool> done(false);
+      boost::thread_group threads;
+      auto then = std::chrono::high_resolution_clock::now();
+      for (unsigned i = 0; i < nthreads; i++) {
+        threads.create_thread([&, i]() {
+            boost::mt19937 generator(i);
+            State state;
+            auto last_merge = std::chrono::high_resolution_clock::now();
+            while (!done) {
+              graphs[i]->sample(state, generator);
+              if (i == 0 && std::chrono::high_resolution_clock::now() - last_merge >= std::chrono::milliseconds(100)) {
+                combined->merge(sources, state, 2);
+                last_merge = std::chrono::high_resolution_clock::now();
+              }
+            }
+          });
+      }
+      boost::this_thread::sleep_for(boost::chrono::seconds(2));
+      done = true;
+      threads.join_all();
+      auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+      State state;
+      combined->merge(sources, state, 2);
+      double samples = combined->node(state)->sample_size();
+      std::cout << nthreads << " " << samples << " " << samples * 1e3 / duration.count() << std::endl;
+    }
+  }
+
+  // one sampling thread, with each new leaf played out several times on a
+  // worker pool.  what should go down is the number of table writes per
+  // playout.
+  std::cout << "leaf-parallel sampling for initial state (playouts per leaf, samples, playouts per second, updates per playout):" << std::endl;
+  {
+    for (unsigned playouts = 1; playouts <= 8; playouts *= 2) {
+      boost::mt19937 generator;
+      State state;
+      std::unique_ptr<mcts::Graph> graph(new mcts::Graph());
+      // the default policy soon settles into lines that end by repetition,
+      // before any playout
+      graph->selection_mode = mcts::selection_uct;
+      graph->set_leaf_parallelism(playouts, playouts - 1, generator);
+      size_t samples = 0;
+      auto then = std::chrono::high_resolution_clock::now();
+      while (std::chrono::high_resolution_clock::now() - then < std::chrono::seconds(2)) {
+        graph->sample(state, generator);
+        samples++;
+      }
+      auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+      std::cout << playouts << " " << samples
+                << " " << samples * playouts * 1e3 / duration.count()
+                << " " << double(graph->updates()) / (samples * playouts) << std::endl;
+    }
+  }
+
+  // playouts cut off and scored by material rather than played to the end
+  std::cout << "playout cutoff for initial state (max plies, samples, samples per second):" << std::endl;
+  {
+    for (unsigned max_plies: {0u, 200u, 100u, 50u, 20u}) {
+      boost::mt19937 generator;
+      State state;
+      std::unique_ptr<mcts::Graph> graph(new mcts::Graph());
+      graph->selection_mode = mcts::selection_uct;
+      // 0 for playouts to the end
+      graph->cutoff = mcts::Cutoff(max_plies > 0, max_plies);
+      size_t samples = 0;
+      auto then = std::chrono::high_resolution_clock::now();
+      while (std::chrono::high_resolution_clock::now() - then < std::chrono::seconds(2)) {
+        graph->sample(state, generator);
+        samples++;
+      }
+      auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+      std::cout << (max_plies > 0 ? std::to_string(max_plies) : "none") << " " << samples << " " << samples * 1e3 / duration.count() << std::endl;
+    }
+  }
+
+  std::cout << "backprop modes for initial state (mode, samples, milliseconds, nodes updated per sample):" << std::endl;
+  {
+    std::vector<std::pair<std::string, mcts::BackpropMode> > backprop_modes = {
+      {"ancestors", mcts::backprop_ancestors},
+      {"path", mcts::backprop_path},
+      {"path_aggregated", mcts::backprop_path_aggregated},
+    };
+    for (auto const& backprop_mode: backprop_modes) {
+      boost::mt19937 generator;
+      State state;
+      std::unique_ptr<mcts::Graph> graph(new mcts::Graph());
+      graph->backprop_mode = backprop_mode.second;
+      const size_t nsamples = 3000;
+      auto then = std::chrono::high_resolution_clock::now();
+      for (size_t i = 0; i < nsamples; i++)
+        graph->sample(state, generator);
+      auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
+      std::cout << backprop_mode.first << " " << nsamples << " " << duration.count()
+                << " " << double(graph->updates()) / nsamples << std::endl;
+    }
+  }
+
+  std::cout << "cumulative sampling durations for initial state (samples, milliseconds, allocations per sample):" << std::endl;
   boost::mt19937 generator;
   State state;
   mcts::Graph graph;
+  size_t allocations0 = allocations;
   auto then = std::chrono::high_resolution_clock::now();
   for (int i = 1; i <= 1e4; i++) {
     graph.sample(state, generator);
     if (i % 1000 == 0) {
       auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - then);
-      std::cout << i << " " << duration.count() << std::endl;
+      std::cout << i << " " << duration.count() << " " << double(allocations - allocations0) / i << std::endl;
     }
   }
 }
@@ -50,8 +50,8 @@ void State::set_initial_configuration() {
   halfmove_clock = 0;
 
   compute_occupancy();
-  compute_their_attacks();
   compute_hash();
+  compute_mailbox();
 }
 
 std::string State::dump_fen() {
@@ -160,8 +160,8 @@ void State::load_fen(std::string fen) {
   halfmove_clock = std::stoi(std::string(m[11].first, m[11].second));
 
   compute_occupancy();
-  compute_their_attacks();
   compute_hash();
+  compute_mailbox();
 }
 
 void State::empty_board() {
@@ -209,11 +209,6 @@ boost::optional<std::string> State::inconsistency() const {
     }
   }
 
-  Occupancy occupancy;
-  board::flatten(this->board, occupancy);
-  if (occupancy != this->occupancy)
-    return std::string("occupancy out of sync");
-
   Bitboard flat_occupancy;
   board::flatten(this->board, flat_occupancy);
   if (flat_occupancy != this->flat_occupancy)
@@ -224,10 +219,15 @@ boost::optional<std::string> State::inconsistency() const {
   if (hash != this->hash)
     return std::string("hash out of sync");
 
-  if (bitboard::cardinality(occupancy[us]) > 16)
+  std::array<uint8_t, squares::cardinality> mailbox;
+  compute_mailbox(mailbox);
+  if (mailbox != this->mailbox)
+    return std::string("mailbox out of sync");
+
+  if (bitboard::cardinality(occupancy(us)) > 16)
     return std::string("we have more than 16 pieces");
 
-  if (bitboard::cardinality(occupancy[them]) > 16)
+  if (bitboard::cardinality(occupancy(them)) > 16)
     return std::string("they have more than 16 pieces");
 
   return boost::none;
@@ -282,24 +282,26 @@ std::ostream& operator<<(std::ostream& o, const State& s) {
   return o;
 }
 
+template <Color Us>
 void State::update_castling_rights(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target) {
+  constexpr Color Them = colors::opposite(Us);
   undo.prior_castling_rights = castling_rights;
 
   switch (piece) {
   case pieces::king:
     for (Castle castle: castles::values) {
-      if (castling_rights[us][castle]) {
-        castling_rights[us][castle] = false;
-        hash ^= hashes::can_castle(us, castle);
+      if (castling_rights[Us][castle]) {
+        castling_rights[Us][castle] = false;
+        hash ^= hashes::can_castle(Us, castle);
       }
     }
     break;
   case pieces::rook:
     {
-      boost::optional<Castle> castle = castles::involving(move.source(), us);
-      if (castle && castling_rights[us][*castle]) {
-        castling_rights[us][*castle] = false;
-        hash ^= hashes::can_castle(us, *castle);
+      boost::optional<Castle> castle = castles::involving(move.source(), Us);
+      if (castle && castling_rights[Us][*castle]) {
+        castling_rights[Us][*castle] = false;
+        hash ^= hashes::can_castle(Us, *castle);
       }
     }
     break;
@@ -312,15 +314,16 @@ void State::update_castling_rights(const Move& move, Undo& undo, const Piece pie
     throw std::runtime_error(str(boost::format("unhandled Piece case: %|1$#x|") % piece));
   }
 
-  if (move.is_capture() && (target & board[them][pieces::rook])) {
-    boost::optional<Castle> castle = castles::involving(move.target(), them);
-    if (castle && castling_rights[them][*castle]) {
-      castling_rights[them][*castle] = false;
-      hash ^= hashes::can_castle(them, *castle);
+  if (move.is_capture() && (target & board[Them][pieces::rook])) {
+    boost::optional<Castle> castle = castles::involving(move.target(), Them);
+    if (castle && castling_rights[Them][*castle]) {
+      castling_rights[Them][*castle] = false;
+      hash ^= hashes::can_castle(Them, *castle);
     }
   }
 }
 
+template <Color Us>
 void State::update_en_passant_square(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target) {
   undo.prior_en_passant_square = en_passant_square;
 
@@ -330,7 +333,7 @@ void State::update_en_passant_square(const Move& move, Undo& undo, const Piece p
   switch (move.type()) {
   case move_types::double_push:
     assert(piece == pieces::pawn);
-    en_passant_square = us == colors::white ? target >> directions::vertical
+    en_passant_square = Us == colors::white ? target >> directions::vertical
                                             : target << directions::vertical;
     hash ^= hashes::en_passant(en_passant_square);
     break;
@@ -353,10 +356,12 @@ void State::update_en_passant_square(const Move& move, Undo& undo, const Piece p
   }
 }
 
+template <Color Us>
 void State::make_move_on_their_halfboard(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target) {
+  constexpr Color Them = colors::opposite(Us);
   using hashes::toggle;
 
-  Halfboard& their_halfboard = board[them];
+  Halfboard& their_halfboard = board[Them];
 
   switch (move.type()) {
   case move_types::capturing_promotion_knight:
@@ -367,40 +372,24 @@ void State::make_move_on_their_halfboard(const Move& move, Undo& undo, const Pie
     if (target == en_passant_square) {
       assert(piece == pieces::pawn);
       // the captured pawn is in front of the en_passant_square
-      Bitboard capture_target = us == colors::white ? target >> directions::vertical
+      Bitboard capture_target = Us == colors::white ? target >> directions::vertical
                                                     : target << directions::vertical;
       assert(their_halfboard[pieces::pawn] & capture_target);
 
       their_halfboard[pieces::pawn] &= ~capture_target;
-      toggle(hash, them, pieces::pawn, squares::index(capture_target));
+      toggle(hash, Them, pieces::pawn, squares::index(capture_target));
+      mailbox[squares::index(capture_target)] = mailbox::empty;
 
       undo.record_capture(pieces::pawn, capture_target);
     } else {
-      // if we need speed, break out of the loop as soon as we find the piece
-      // we're looking for.  otherwise keep going to test the assumption that
-      // exactly one piece was there.
-#ifdef MC_EXPENSIVE_RUNTIME_TESTS
-      Halfboard their_prior_halfboard = Halfboard(their_halfboard);
-      bool found = false;
-#endif
-      for (Piece capturee: pieces::values) {
-        if (their_halfboard[capturee] & target) {
-#ifdef MC_EXPENSIVE_RUNTIME_TESTS
-          assert(!found /* no more than on piece on this square? */);
-          found = true;
-#endif
-          their_halfboard[capturee] &= ~target;
-          toggle(hash, them, capturee, squares::index(target));
+      assert(mailbox::color(mailbox[move.target()]) == Them);
+      Piece capturee = mailbox::piece(mailbox[move.target()]);
+      assert(their_halfboard[capturee] & target);
 
-          undo.record_capture(capturee, target);
-#ifndef MC_EXPENSIVE_RUNTIME_TESTS
-          break;
-#endif
-        }
-      }
-#ifdef MC_EXPENSIVE_RUNTIME_TESTS
-      assert(found == true /* at least one piece on this square? */);
-#endif
+      their_halfboard[capturee] &= ~target;
+      toggle(hash, Them, capturee, move.target());
+
+      undo.record_capture(capturee, target);
     }
     break;
   case move_types::double_push:
@@ -418,16 +407,19 @@ void State::make_move_on_their_halfboard(const Move& move, Undo& undo, const Pie
   }
 }
 
+template <Color Us>
 void State::make_move_on_our_halfboard(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target) {
   using namespace pieces;
   using hashes::toggle;
 
-  Halfboard& our_halfboard = board[us];
+  Halfboard& our_halfboard = board[Us];
 
   assert(our_halfboard[piece] & source);
 
-  our_halfboard[piece] &= ~source; toggle(hash, us, piece, move.source());
-  our_halfboard[piece] |=  target; toggle(hash, us, piece, move.target());
+  our_halfboard[piece] &= ~source; toggle(hash, Us, piece, move.source());
+  our_halfboard[piece] |=  target; toggle(hash, Us, piece, move.target());
+  mailbox[move.source()] = mailbox::empty;
+  mailbox[move.target()] = mailbox::encode(Us, piece);
 
   switch (move.type()) {
   case move_types::castle_kingside:
@@ -435,33 +427,39 @@ void State::make_move_on_our_halfboard(const Move& move, Undo& undo, const Piece
     {
       squares::Index rook0 = castles::rook_source(move.target());
       squares::Index rook1 = castles::rook_target(move.target());
-      our_halfboard[rook] &= ~squares::bitboard(rook0); toggle(hash, us, rook, rook0);
-      our_halfboard[rook] |=  squares::bitboard(rook1); toggle(hash, us, rook, rook1);
+      our_halfboard[rook] &= ~squares::bitboard(rook0); toggle(hash, Us, rook, rook0);
+      our_halfboard[rook] |=  squares::bitboard(rook1); toggle(hash, Us, rook, rook1);
+      mailbox[rook0] = mailbox::empty;
+      mailbox[rook1] = mailbox::encode(Us, rook);
     }
     break;
   case move_types::capturing_promotion_knight:
   case move_types::promotion_knight:
     assert(piece == pawn);
-    our_halfboard[piece]  &= ~target; toggle(hash, us, pawn,   move.target());
-    our_halfboard[knight] |=  target; toggle(hash, us, knight, move.target());
+    our_halfboard[piece]  &= ~target; toggle(hash, Us, pawn,   move.target());
+    our_halfboard[knight] |=  target; toggle(hash, Us, knight, move.target());
+    mailbox[move.target()] = mailbox::encode(Us, knight);
     break;
   case move_types::capturing_promotion_bishop:
   case move_types::promotion_bishop:
     assert(piece == pawn);
-    our_halfboard[piece]  &= ~target; toggle(hash, us, pawn,   move.target());
-    our_halfboard[bishop] |=  target; toggle(hash, us, bishop, move.target());
+    our_halfboard[piece]  &= ~target; toggle(hash, Us, pawn,   move.target());
+    our_halfboard[bishop] |=  target; toggle(hash, Us, bishop, move.target());
+    mailbox[move.target()] = mailbox::encode(Us, bishop);
     break;
   case move_types::capturing_promotion_rook:
   case move_types::promotion_rook:
     assert(piece == pawn);
-    our_halfboard[piece] &= ~target; toggle(hash, us, pawn,  move.target());
-    our_halfboard[rook]  |=  target; toggle(hash, us, rook,  move.target());
+    our_halfboard[piece] &= ~target; toggle(hash, Us, pawn,  move.target());
+    our_halfboard[rook]  |=  target; toggle(hash, Us, rook,  move.target());
+    mailbox[move.target()] = mailbox::encode(Us, rook);
     break;
   case move_types::capturing_promotion_queen:
   case move_types::promotion_queen:
     assert(piece == pawn);
-    our_halfboard[piece] &= ~target; toggle(hash, us, pawn,  move.target());
-    our_halfboard[queen] |=  target; toggle(hash, us, queen, move.target());
+    our_halfboard[piece] &= ~target; toggle(hash, Us, pawn,  move.target());
+    our_halfboard[queen] |=  target; toggle(hash, Us, queen, move.target());
+    mailbox[move.target()] = mailbox::encode(Us, queen);
     break;
   case move_types::capture:
   case move_types::double_push:
@@ -472,9 +470,10 @@ void State::make_move_on_our_halfboard(const Move& move, Undo& undo, const Piece
   }
 }
 
+template <Color Us>
 void State::make_move_on_occupancy(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target) {
-  occupancy[us] &= ~source;
-  occupancy[us] |=  target;
+  flat_occupancy &= ~source;
+  flat_occupancy |=  target;
 
   switch (move.type()) {
   case move_types::capturing_promotion_knight:
@@ -482,21 +481,19 @@ void State::make_move_on_occupancy(const Move& move, Undo& undo, const Piece pie
   case move_types::capturing_promotion_rook:
   case move_types::capturing_promotion_queen:
   case move_types::capture:
-    {
-      Bitboard capture_target = target;
-      if (target == en_passant_square) {
-        capture_target = (us == colors::white
-                          ? target >> directions::vertical
-                          : target << directions::vertical);
-      }
-      assert(occupancy[them] & capture_target);
-      occupancy[them] &= ~capture_target;
+    // the target was and stays occupied, except for en-passant captures
+    if (target == en_passant_square) {
+      Bitboard capture_target = (Us == colors::white
+                                 ? target >> directions::vertical
+                                 : target << directions::vertical);
+      assert(flat_occupancy & capture_target);
+      flat_occupancy &= ~capture_target;
     }
     break;
   case move_types::castle_kingside:
   case move_types::castle_queenside:
-    occupancy[us] &= ~squares::bitboard(castles::rook_source(move.target()));
-    occupancy[us] |=  squares::bitboard(castles::rook_target(move.target()));
+    flat_occupancy &= ~squares::bitboard(castles::rook_source(move.target()));
+    flat_occupancy |=  squares::bitboard(castles::rook_target(move.target()));
     break;
   case move_types::double_push:
   case move_types::promotion_knight:
@@ -508,29 +505,30 @@ void State::make_move_on_occupancy(const Move& move, Undo& undo, const Piece pie
   default:
     throw std::runtime_error(str(boost::format("unhandled MoveType case: %|1$#x|") % move.type()));
   }
-
-  flat_occupancy = occupancy[us] | occupancy[them];
 }
 
+template <Color Us>
 Undo State::make_move(const Move& move) {
+  assert(us == Us);
   Undo undo;
   undo.move = move;
+  undo.prior_hash = hash;
+  undo.prior_flat_occupancy = flat_occupancy;
 
   Bitboard source = squares::bitboard(move.source()),
            target = squares::bitboard(move.target());
-  Piece piece = piece_at(move.source(), us);
-
-#ifdef MC_EXPENSIVE_RUNTIME_TESTS
-  State prior_state(*this);
-#endif
-
-  update_castling_rights       (move, undo, piece, source, target);
-  make_move_on_our_halfboard   (move, undo, piece, source, target);
-  make_move_on_their_halfboard (move, undo, piece, source, target);
-  make_move_on_occupancy       (move, undo, piece, source, target);
-  update_en_passant_square     (move, undo, piece, source, target);
-
-  std::swap(us, them);
+  Piece piece = piece_at(move.source(), Us);
+
+  // their halfboard first, so the captured piece can be found in the mailbox
+  // before ours overwrites it
+  update_castling_rights       <Us>(move, undo, piece, source, target);
+  make_move_on_their_halfboard <Us>(move, undo, piece, source, target);
+  make_move_on_our_halfboard   <Us>(move, undo, piece, source, target);
+  make_move_on_occupancy       <Us>(move, undo, piece, source, target);
+  update_en_passant_square     <Us>(move, undo, piece, source, target);
+
+  us = colors::opposite(Us);
+  them = Us;
   hash ^= hashes::black_to_move();
 
   undo.prior_halfmove_clock = halfmove_clock;
@@ -540,10 +538,16 @@ Undo State::make_move(const Move& move) {
     halfmove_clock++;
   }
 
-  compute_their_attacks();
   return undo;
 }
 
+template Undo State::make_move<colors::white>(const Move& move);
+template Undo State::make_move<colors::black>(const Move& move);
+
+Undo State::make_move(const Move& move) {
+  return us == colors::white ? make_move<colors::white>(move) : make_move<colors::black>(move);
+}
+
 void State::unmake_move(const Undo& undo) {
 #ifdef MC_EXPENSIVE_RUNTIME_TESTS
   require_consistent(); // before unmake
@@ -554,45 +558,52 @@ void State::unmake_move(const Undo& undo) {
   Piece piece = piece_at(undo.move.target(), us);
 
   // move back our piece
-  board[us][piece] &= ~squares::bitboard(undo.move.target());
-  if (undo.move.is_promotion()) {
-    // demote
-    board[us][pieces::pawn] |= squares::bitboard(undo.move.source());
-  } else {
-    board[us][piece]        |= squares::bitboard(undo.move.source());
-  }
+  Piece prior_piece = undo.move.is_promotion() ? pieces::pawn : piece;
+  board[us][piece]       &= ~squares::bitboard(undo.move.target());
+  board[us][prior_piece] |=  squares::bitboard(undo.move.source());
+  mailbox[undo.move.target()] = mailbox::empty;
+  mailbox[undo.move.source()] = mailbox::encode(us, prior_piece);
 
   // in case of castle, move the rook back as well
   if (undo.move.is_castle()) {
-    board[us][pieces::rook] =
-      (board[us][pieces::rook]
-       & ~squares::bitboard(castles::rook_target(undo.move.target())))
-      | squares::bitboard(castles::rook_source(undo.move.target()));
+    squares::Index rook0 = castles::rook_source(undo.move.target());
+    squares::Index rook1 = castles::rook_target(undo.move.target());
+    board[us][pieces::rook] = (board[us][pieces::rook] & ~squares::bitboard(rook1)) | squares::bitboard(rook0);
+    mailbox[rook1] = mailbox::empty;
+    mailbox[rook0] = mailbox::encode(us, pieces::rook);
   }
 
   // replace any captured piece
-  board[them][undo.captured_piece] |= undo.capture_square;
+  if (undo.capture_square) {
+    board[them][undo.captured_piece] |= undo.capture_square;
+    mailbox[squares::index(undo.capture_square)] = mailbox::encode(them, undo.captured_piece);
+  }
 
   halfmove_clock = undo.prior_halfmove_clock;
   en_passant_square = undo.prior_en_passant_square;
   castling_rights = undo.prior_castling_rights;
 
-  compute_hash();
-  compute_occupancy();
-  compute_their_attacks();
+  hash = undo.prior_hash;
+  flat_occupancy = undo.prior_flat_occupancy;
 
 #ifdef MC_EXPENSIVE_RUNTIME_TESTS
   require_consistent(); // after unmake
 #endif
 }
 
-void State::compute_occupancy(Occupancy& occupancy, Bitboard& flat_occupancy) const {
-  board::flatten(board, occupancy);
-  board::flatten(occupancy, flat_occupancy);
+void State::compute_occupancy(Bitboard& flat_occupancy) const {
+  board::flatten(board, flat_occupancy);
 }
 
-void State::compute_their_attacks(Bitboard& their_attacks) const {
-  their_attacks = targets::attacks(them, flat_occupancy, board[them]);
+void State::compute_mailbox(std::array<uint8_t, squares::cardinality>& mailbox) const {
+  mailbox.fill(mailbox::empty);
+  for (Color c: colors::values) {
+    for (Piece p: pieces::values) {
+      squares::for_each(board[c][p], [&](squares::Index si) {
+          mailbox[si] = mailbox::encode(c, p);
+        });
+    }
+  }
 }
 
 void State::compute_hash(Hash &hash) const {
@@ -618,19 +629,16 @@ void State::compute_hash(Hash &hash) const {
 }
 
 boost::optional<ColoredPiece> State::colored_piece_at(squares::Index square) const {
-  Bitboard bitboard = squares::bitboard(square);
-  for (Color color: colors::values)
-    for (Piece piece: pieces::values)
-      if (board[color][piece] & bitboard)
-        return ColoredPiece(color, piece);
-  return boost::none;
+  uint8_t code = mailbox[square];
+  if (code == mailbox::empty)
+    return boost::none;
+  return ColoredPiece(mailbox::color(code), mailbox::piece(code));
 }
 
 Piece State::piece_at(squares::Index square, Color color) const {
-  Bitboard bitboard = squares::bitboard(square);
-  for (Piece piece: pieces::values)
-    if (board[color][piece] & bitboard)
-      return piece;
+  uint8_t code = mailbox[square];
+  if (code != mailbox::empty && mailbox::color(code) == color)
+    return mailbox::piece(code);
   std::cerr << "State::piece_at: no " << colors::name(color) << " piece at " << squares::keywords.at(square) << " in state: " << std::endl;
   std::cerr << *this << std::endl;
   print_backtrace();
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <type_traits>
 #include <boost/optional.hpp>
 
 #include "util.hpp"
@@ -14,28 +16,35 @@
 #include "undo.hpp"
 #include "targets.hpp"
 
+// compact and trivially copyable, so that copying a state and making a move
+// on the copy is cheaper than making and unmaking it in place.  quantities
+// that are cheap to derive from the board (per-color occupancy, their
+// attacks) are not stored; the mailbox is, because piece lookups are on the
+// path of every move.
 class State {
 public:
-  Color us, them;
-
   Board board;
 
-  // false iff the relevant rook or king has moved.
-  CastlingRights castling_rights;
+  // redundant
+  Bitboard flat_occupancy;
+  Hash hash;
 
   // if en-passant capture is possible, this is the square where a capturing
   // pawn will end up.
   Bitboard en_passant_square;
 
+  Color us, them;
+
+  // false iff the relevant rook or king has moved.
+  CastlingRights castling_rights;
+
   // number of halfmoves since last capture or pawn move
   // NOTE: does not affect hash
-  size_t halfmove_clock;
+  uint16_t halfmove_clock;
 
-  // redundant
-  Occupancy occupancy;
-  Bitboard flat_occupancy;
-  Bitboard their_attacks;
-  Hash hash;
+  // redundant; the piece on each square as encoded by mailbox::encode, so that
+  // looking up a piece doesn't mean looping over the board.
+  std::array<uint8_t, squares::cardinality> mailbox;
 
   State();
   State(std::string fen);
@@ -50,35 +59,54 @@ public:
 
   friend std::ostream& operator<<(std::ostream& o, const State& s);
 
-  void update_castling_rights(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
-  void update_en_passant_square(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
-  void make_move_on_their_halfboard(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
-  void make_move_on_our_halfboard(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
-  void make_move_on_occupancy(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
+  // the templates are for a compile-time color to move, which must be us
+  template <Color Us> void update_castling_rights(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
+  template <Color Us> void update_en_passant_square(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
+  template <Color Us> void make_move_on_their_halfboard(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
+  template <Color Us> void make_move_on_our_halfboard(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
+  template <Color Us> void make_move_on_occupancy(const Move& move, Undo& undo, const Piece piece, const Bitboard source, const Bitboard target);
 
+  template <Color Us> Undo make_move(const Move& move);
   Undo make_move(const Move& move);
   void unmake_move(const Undo& undo);
 
-  inline void compute_occupancy()     { compute_occupancy(occupancy, flat_occupancy); }
-  inline void compute_their_attacks() { compute_their_attacks(their_attacks); }
-  inline void compute_hash()          { compute_hash(hash); }
+  inline void compute_occupancy() { compute_occupancy(flat_occupancy); }
+  inline void compute_hash()      { compute_hash(hash); }
+  inline void compute_mailbox()   { compute_mailbox(mailbox); }
 
-  void compute_occupancy(Occupancy& occupancy, Bitboard& flat_occupancy) const;
-  void compute_their_attacks(Bitboard& their_attacks) const;
+  void compute_occupancy(Bitboard& flat_occupancy) const;
   void compute_hash(Hash &hash) const;
+  void compute_mailbox(std::array<uint8_t, squares::cardinality>& mailbox) const;
+
+  inline Bitboard occupancy(Color color) const {
+    Bitboard occupancy = 0;
+    for (Bitboard pieces: board[color])
+      occupancy |= pieces;
+    return occupancy;
+  }
+
+  inline Bitboard their_attacks() const {
+    return targets::attacks(them, flat_occupancy, board[them]);
+  }
 
   boost::optional<ColoredPiece> colored_piece_at(squares::Index square) const;
   Piece piece_at(squares::Index square, Color color) const;
   boost::optional<Color> winner() const;
 
+  template <Color Us>
   inline bool can_castle(Castle castle) const {
-    return castling_rights[us][castle]
-      && !(castles::safe_squares(us, castle) & their_attacks)
-      && !(castles::free_squares(us, castle) & flat_occupancy);
+    constexpr Color Them = colors::opposite(Us);
+    return castling_rights[Us][castle]
+      && !(castles::free_squares(Us, castle) & flat_occupancy)
+      && !targets::any_attacked<Them>(castles::safe_squares(Us, castle), flat_occupancy, board[Them]);
+  }
+
+  inline bool can_castle(Castle castle) const {
+    return us == colors::white ? can_castle<colors::white>(castle) : can_castle<colors::black>(castle);
   }
 
   inline bool in_check() const {
-    return their_attacks & board[us][pieces::king];
+    return targets::any_attacked(board[us][pieces::king], flat_occupancy, them, board[them]);
   }
 
   inline bool their_king_attacked() const {
@@ -103,3 +131,6 @@ public:
     return halfmove_clock >= 50;
   }
 };
+
+static_assert(sizeof(State) <= 192, "State should fit in three cache lines");
+static_assert(std::is_trivially_copyable<State>::value, "State should be copyable with memcpy");
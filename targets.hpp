@@ -3,8 +3,10 @@
 #include <vector>
 
 #include "bitboard.hpp"
+#include "board.hpp"
 #include "direction.hpp"
 #include "partitions.hpp"
+#include "magics.hpp"
 
 namespace targets {
   // color-specific pawn stuff
@@ -115,24 +117,49 @@ namespace targets {
     {0, directions::vertical + 2*directions::horizontal, files::bitboards::g | files::bitboards::h },
   };
   
+  inline Bitboard knight_attacks(Bitboard knights) {
+    Bitboard attacks = 0;
+    for (const KnightAttackType &ka: knight_attack_types)
+      attacks |= ka.attacks(knights);
+    return attacks;
+  }
+
   inline Bitboard pawn_attacks(Bitboard pawn, PawnDingbat const& pd, PawnAttackType const& pa) {
     return (pawn << (pd.leftshift + pa.leftshift) >> (pd.rightshift + pa.rightshift)) & ~pa.badtarget;
   }
   
-  inline Bitboard bishop_attacks(squares::Index source, Bitboard occupancy) {
+  // reference implementations; the table-driven versions in magics.hpp are
+  // built and checked against these.
+  inline Bitboard hyperbola_bishop_attacks(squares::Index source, Bitboard occupancy) {
     Bitboard sources = squares::bitboard(source);
     return 
       slides(occupancy, sources, diagonals::bitboards::by_square(source) & ~sources) |
       slides(occupancy, sources, giadonals::bitboards::by_square(source) & ~sources);
   }
   
-  inline Bitboard rook_attacks(squares::Index source, Bitboard occupancy) {
+  inline Bitboard hyperbola_rook_attacks(squares::Index source, Bitboard occupancy) {
     Bitboard sources = squares::bitboard(source);
     return
       slides     (occupancy, sources, files::bitboards::by_square(source) & ~sources) |
       slides_rank(occupancy, sources, ranks::by_square(source));
   }
   
+  inline Bitboard bishop_attacks(squares::Index source, Bitboard occupancy) {
+#ifdef MC_HYPERBOLA_ATTACKS
+    return hyperbola_bishop_attacks(source, occupancy);
+#else
+    return magics::bishop_attacks(source, occupancy);
+#endif
+  }
+
+  inline Bitboard rook_attacks(squares::Index source, Bitboard occupancy) {
+#ifdef MC_HYPERBOLA_ATTACKS
+    return hyperbola_rook_attacks(source, occupancy);
+#else
+    return magics::rook_attacks(source, occupancy);
+#endif
+  }
+
   inline Bitboard queen_attacks(squares::Index source, Bitboard occupancy) {
     return bishop_attacks(source, occupancy) | rook_attacks(source, occupancy);
   }
@@ -146,14 +173,14 @@ namespace targets {
   }
   
   // NOTE: includes attacks on own pieces
-  inline Bitboard attacks(Color us, Bitboard occupancy, Halfboard const& attackers) {
+  template <Color Us>
+  inline Bitboard attacks(Bitboard occupancy, Halfboard const& attackers) {
     Bitboard attacks = 0;
     
     for (const PawnAttackType &pa: pawn_attack_types)
-      attacks |= pawn_attacks(attackers[pieces::pawn], pawn_dingbats[us], pa);
+      attacks |= pawn_attacks(attackers[pieces::pawn], pawn_dingbats[Us], pa);
     
-    for (const KnightAttackType &ka: knight_attack_types)
-      attacks |= ka.attacks(attackers[pieces::knight]);
+    attacks |= knight_attacks(attackers[pieces::knight]);
     
     squares::for_each(attackers[pieces::bishop], [&](squares::Index source) {
         attacks |= bishop_attacks(source, occupancy);
@@ -170,12 +197,19 @@ namespace targets {
     return attacks | king_attacks(attackers[pieces::king]);
   }
 
-  inline Bitboard attackers(Bitboard targets, Bitboard occupancy, Color attacker, Halfboard const& attackers, bool early_return = false) {
+  inline Bitboard attacks(Color us, Bitboard occupancy, Halfboard const& attackers) {
+    return us == colors::white
+      ? attacks<colors::white>(occupancy, attackers)
+      : attacks<colors::black>(occupancy, attackers);
+  }
+
+  template <Color Attacker>
+  inline Bitboard attackers(Bitboard targets, Bitboard occupancy, Halfboard const& attackers, bool early_return = false) {
     // put a superpiece on each target; if it attacks an attacker with the
     // appropriate mobility, the attacker is attacking at least one of the
     // targets.
 
-    Color defender = colors::opposite(attacker);
+    constexpr Color defender = colors::opposite(Attacker);
 
     Bitboard sources = 0;
 
@@ -211,6 +245,17 @@ namespace targets {
     return sources;
   }
 
+  inline Bitboard attackers(Bitboard targets, Bitboard occupancy, Color attacker, Halfboard const& attackers, bool early_return = false) {
+    return attacker == colors::white
+      ? targets::attackers<colors::white>(targets, occupancy, attackers, early_return)
+      : targets::attackers<colors::black>(targets, occupancy, attackers, early_return);
+  }
+
+  template <Color Attacker>
+  inline bool any_attacked(Bitboard targets, Bitboard occupancy, Halfboard const& attackers) {
+    return targets::attackers<Attacker>(targets, occupancy, attackers, true);
+  }
+
   inline bool any_attacked(Bitboard targets, Bitboard occupancy, Color attacker, Halfboard const& attackers) {
     return targets::attackers(targets, occupancy, attacker, attackers, true);
   }
@@ -9,6 +9,8 @@
 #include <boost/format.hpp>
 #include <boost/random.hpp>
 #include <boost/optional/optional_io.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
 
 #include "../util.hpp"
 #include "../direction.hpp"
@@ -17,17 +19,15 @@
 #include "../hash.hpp"
 #include "../mcts.hpp"
 #include "../mcts_agent.hpp"
+#include "../playout_pool.hpp"
 #include "../notation.hpp"
 #include "../targets.hpp"
+#include "../magics.hpp"
 
 // NOTE: evaluates arguments twice
 #define BOOST_CHECK_BITBOARDS_EQUAL(a, b) \
   BOOST_CHECK_MESSAGE((a) == (b), boost::format("%|1$#x| != %|2$#x|") % (a) % (b));
 
-BOOST_AUTO_TEST_CASE(randompoop) {
-  hashes::generate_random_feature();
-}
-
 BOOST_AUTO_TEST_CASE(partitions) {
   using namespace squares::bitboards;
   BOOST_CHECK_EQUAL(bitboard::cardinality(0x1), 1);
@@ -50,6 +50,12 @@ BOOST_AUTO_TEST_CASE(in_between) {
   BOOST_CHECK_BITBOARDS_EQUAL(squares::in_between(squares::b6, squares::f2), c5 | d4 | e3);
   BOOST_CHECK_BITBOARDS_EQUAL(squares::in_between(squares::b6, squares::f1), 0);
   BOOST_CHECK_BITBOARDS_EQUAL(squares::in_between(squares::b6, squares::b3), b5 | b4);
+
+  // the geometry tables and hash keys are computed at compile time
+  static_assert(squares::in_between(squares::a1, squares::c3) == b2, "in_between not constexpr");
+  static_assert(diagonals::bitboards::by_square(squares::e4) == diagonals::bitboards::a8h1, "by_square not constexpr");
+  static_assert(castles::safe_squares(colors::black, castles::queenside) == (e8 | d8 | c8), "castles not constexpr");
+  static_assert(hashes::can_castle(colors::white, castles::kingside) != hashes::can_castle(colors::black, castles::kingside), "hashes not constexpr");
 }
 
 BOOST_AUTO_TEST_CASE(initial_moves) {
@@ -66,7 +72,7 @@ BOOST_AUTO_TEST_CASE(initial_moves) {
       expected_moves.emplace(from, from + 2*north + east, move_types::normal);
     });
 
-  const std::vector<Move> moves = moves::moves(state);
+  const MoveList moves = moves::moves(state);
   const std::set<Move> actual_moves(moves.begin(), moves.end());
 
   std::set<Move> falsenegatives, falsepositives;
@@ -108,6 +114,24 @@ BOOST_AUTO_TEST_CASE(rays_every_which_way) {
                               0x0404040404fb0404);
 }
 
+BOOST_AUTO_TEST_CASE(slider_attack_tables) {
+  // the tables should agree with hyperbola quintessence on occupancies of
+  // varying density.
+  boost::mt19937 generator;
+  boost::random::uniform_int_distribution<Bitboard> distribution;
+  for (int i = 0; i < 1000; i++) {
+    Bitboard occupancy = distribution(generator);
+    for (int j = 0; j < i % 4; j++)
+      occupancy &= distribution(generator);
+    for (squares::Index source: squares::indices) {
+      BOOST_CHECK_BITBOARDS_EQUAL(magics::bishop_attacks(source, occupancy),
+                                  targets::hyperbola_bishop_attacks(source, occupancy));
+      BOOST_CHECK_BITBOARDS_EQUAL(magics::rook_attacks(source, occupancy),
+                                  targets::hyperbola_rook_attacks(source, occupancy));
+    }
+  }
+}
+
 BOOST_AUTO_TEST_CASE(various_moves) {
   State state("r1b2rk1/pp1P1p1p/q1p2n2/2N2PpB/1NP2bP1/2R1B3/PP2Q2P/R3K3 w Q g6 0 1");
 
@@ -129,7 +153,7 @@ BOOST_AUTO_TEST_CASE(various_moves) {
     BOOST_CHECK_BITBOARDS_EQUAL(state.board[black][queen],  a6);
     BOOST_CHECK_BITBOARDS_EQUAL(state.board[black][king],   g8);
     BOOST_CHECK_BITBOARDS_EQUAL(state.en_passant_square,    g6);
-    BOOST_CHECK_BITBOARDS_EQUAL(state.their_attacks, 0xfeef5fdbf5518100);
+    BOOST_CHECK_BITBOARDS_EQUAL(state.their_attacks(), 0xfeef5fdbf5518100);
     BOOST_CHECK(!state.castling_rights[white][kingside]);
     BOOST_CHECK(!state.castling_rights[black][kingside]);
     BOOST_CHECK( state.castling_rights[white][queenside]);
@@ -218,7 +242,7 @@ BOOST_AUTO_TEST_CASE(various_moves) {
     }
   }
 
-  const std::vector<Move> moves = moves::moves(state);
+  const MoveList moves = moves::moves(state);
   const std::set<Move> actual_moves(moves.begin(), moves.end());
 
   std::set<Move> falsenegatives, falsepositives;
@@ -244,8 +268,8 @@ BOOST_AUTO_TEST_CASE(algebraic_moves) {
     state.make_move(move);
   }
 
-  BOOST_CHECK_BITBOARDS_EQUAL(state.occupancy[white], 0x000000001426e167);
-  BOOST_CHECK_BITBOARDS_EQUAL(state.occupancy[black], 0xd5ef240100080000);
+  BOOST_CHECK_BITBOARDS_EQUAL(state.occupancy(white), 0x000000001426e167);
+  BOOST_CHECK_BITBOARDS_EQUAL(state.occupancy(black), 0xd5ef240100080000);
 
   for (std::string word: words("e5 Qg6 Re1 Nge7 Ba3 b5 Qxb5 Rb8 Qa4 Bb6 Nbd2 Bb7 Ne4 Qf5 "
                                "Bxd3 Qh5 Nf6+ gxf6 exf6 Rg8 Rad1 Qxf3 Rxe7+ Nxe7 Qxd7+ "
@@ -267,9 +291,9 @@ BOOST_AUTO_TEST_CASE(algebraic_moves) {
   BOOST_CHECK_BITBOARDS_EQUAL(state.board[black][queen],  0x0000000000200000);
   BOOST_CHECK_BITBOARDS_EQUAL(state.board[black][king],   0x2000000000000000);
   BOOST_CHECK_BITBOARDS_EQUAL(state.en_passant_square,    0x0000000000000000);
-  BOOST_CHECK_BITBOARDS_EQUAL(state.their_attacks,        0xfd777fed78fc7008);
-  BOOST_CHECK_BITBOARDS_EQUAL(state.occupancy[white],     0x000820000005e148);
-  BOOST_CHECK_BITBOARDS_EQUAL(state.occupancy[black],     0x62b7020000200000);
+  BOOST_CHECK_BITBOARDS_EQUAL(state.their_attacks(),        0xfd777fed78fc7008);
+  BOOST_CHECK_BITBOARDS_EQUAL(state.occupancy(white),     0x000820000005e148);
+  BOOST_CHECK_BITBOARDS_EQUAL(state.occupancy(black),     0x62b7020000200000);
   BOOST_CHECK_EQUAL(state.us, white);
 
   std::set<Move> expected_moves;
@@ -292,7 +316,7 @@ BOOST_AUTO_TEST_CASE(algebraic_moves) {
   MV(g1, h1, move_types::normal);
 #undef MV
 
-  std::vector<Move> moves = moves::moves(state);
+  MoveList moves = moves::moves(state);
   std::set<Move> actual_moves(moves.begin(), moves.end());
 
   std::set<Move> falsenegatives, falsepositives;
@@ -359,7 +383,7 @@ BOOST_AUTO_TEST_CASE(king_capture) {
   MV(d5, e4, move_types::normal);
 #undef MV
 
-  std::vector<Move> moves = moves::moves(state);
+  MoveList moves = moves::moves(state);
   std::set<Move> actual_moves(moves.begin(), moves.end());
 
   std::set<Move> falsenegatives, falsepositives;
@@ -401,10 +425,93 @@ BOOST_AUTO_TEST_CASE(unmake_move) {
     Undo undo = state2.make_move(*move);
     state2.unmake_move(undo);
     BOOST_CHECK_EQUAL(state, state2);
+    // unmake restores the redundant fields rather than recomputing them
+    BOOST_CHECK_BITBOARDS_EQUAL(state.flat_occupancy, state2.flat_occupancy);
+    BOOST_CHECK_EQUAL(state.halfmove_clock, state2.halfmove_clock);
+    BOOST_CHECK_EQUAL(state2.inconsistency(), boost::none);
     state.make_move(*move);
   }
 }
 
+BOOST_AUTO_TEST_CASE(legal_moves) {
+  // compare against filtering pseudolegal moves, along random games from
+  // positions with pins, checks and en-passant captures.
+  boost::mt19937 generator;
+  for (std::string fen: {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                         "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+                         "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+                         "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"}) {
+    for (int i = 0; i < 10; i++) {
+      State state(fen);
+      while (true) {
+        MoveList expected_moves = moves::moves(state);
+        moves::erase_illegal_moves(expected_moves, state);
+        MoveList actual_moves = moves::legal_moves(state);
+
+        std::set<Move> expected(expected_moves.begin(), expected_moves.end());
+        std::set<Move> actual(actual_moves.begin(), actual_moves.end());
+        BOOST_REQUIRE_MESSAGE(expected == actual, "legal moves " << actual << " != " << expected << " in state: " << state.dump_fen());
+        BOOST_REQUIRE_EQUAL(actual_moves.size(), actual.size());
+
+        boost::optional<Move> sampled_move = moves::random_legal_move(state, generator);
+        BOOST_REQUIRE_EQUAL(!sampled_move, actual_moves.empty());
+        if (!sampled_move)
+          break;
+        BOOST_REQUIRE_MESSAGE(actual.count(*sampled_move), "sampled illegal move " << *sampled_move << " in state: " << state.dump_fen());
+        state.make_move(random_element(actual_moves, generator));
+        BOOST_REQUIRE_EQUAL(state.inconsistency(), boost::none);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(random_legal_move_uniform) {
+  // promotions, captures, checks and an en-passant capture
+  State state("r3k2r/1P1pqpb1/bn2pnp1/2pPN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq c6 0 1");
+  boost::mt19937 generator;
+  MoveList moves = moves::legal_moves(state);
+  std::map<Move, size_t> frequencies;
+  const size_t samples_per_move = 1000;
+  for (size_t i = 0; i < samples_per_move * moves.size(); i++)
+    frequencies[*moves::random_legal_move(state, generator)]++;
+  BOOST_CHECK_EQUAL(frequencies.size(), moves.size());
+  for (Move move: moves) {
+    // about five standard deviations
+    BOOST_CHECK_MESSAGE(std::abs((double)frequencies[move] - samples_per_move) < 160,
+                        move << " sampled " << frequencies[move] << " times, expected about " << samples_per_move);
+  }
+}
+
+size_t perft(State& state, int depth) {
+  if (depth == 0)
+    return 1;
+  MoveList moves = moves::legal_moves(state);
+  if (depth == 1)
+    return moves.size();
+  size_t count = 0;
+  for (Move move: moves) {
+    Undo undo = state.make_move(move);
+    count += perft(state, depth - 1);
+    state.unmake_move(undo);
+  }
+  return count;
+}
+
+BOOST_AUTO_TEST_CASE(perft_counts) {
+  // from https://chessprogramming.wikispaces.com/Perft+Results
+  std::vector<std::tuple<std::string, int, size_t> > cases = {
+    std::make_tuple("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 3, 8902),
+    std::make_tuple("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 2, 2039),
+    std::make_tuple("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 43238),
+    std::make_tuple("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3, 9467),
+    std::make_tuple("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 2, 1486),
+  };
+  for (auto const& c: cases) {
+    State state(std::get<0>(c));
+    BOOST_CHECK_MESSAGE(perft(state, std::get<1>(c)) == std::get<2>(c), "perft mismatch for " << std::get<0>(c));
+  }
+}
+
 BOOST_AUTO_TEST_CASE(mcts_agent) {
   State state;
   MCTSAgent agent(2);
@@ -416,6 +523,22 @@ BOOST_AUTO_TEST_CASE(mcts_agent) {
   decision.get();
 }
 
+BOOST_AUTO_TEST_CASE(mcts_agent_root_parallel) {
+  State state;
+  MCTSAgent agent(2, 64);
+  agent.set_parallelism(MCTSAgent::root_parallel);
+  agent.set_leaf_parallelism(2, 1);
+  agent.set_state(state);
+  auto decision = agent.start_decision(1);
+  Move move = decision.get();
+  MoveList moves;
+  moves::legal_moves(moves, state);
+  BOOST_CHECK(std::find(moves.begin(), moves.end(), move) != moves.end());
+  agent.advance_state(move);
+  decision = agent.start_decision(1);
+  decision.get();
+}
+
 // better than the other.
 BOOST_AUTO_TEST_CASE(mcts_agent_certain_win) {
   // observed in testing; black has two moves, Kxh4 and g5.  after g5,
@@ -449,6 +572,487 @@ BOOST_AUTO_TEST_CASE(serialize_mcts_agent) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(node_concurrent_updates) {
+  // no update should be lost, and sample size and mean should agree
+  mcts::Node node;
+  const unsigned nthreads = 4, nupdates = 1e5;
+  boost::thread_group threads;
+  for (unsigned i = 0; i < nthreads; i++) {
+    threads.create_thread([&node, i]() {
+        for (unsigned j = 0; j < nupdates; j++)
+          node.update(i % 2 ? mcts::win_value : mcts::draw_value);
+      });
+  }
+  threads.join_all();
+  BOOST_CHECK_EQUAL(node.sample_size(), nthreads * nupdates);
+  BOOST_CHECK_CLOSE(node.mean(), 0.75, 1);
+  BOOST_CHECK_CLOSE(node.variance(), 0.0625, 1);
+}
+
+BOOST_AUTO_TEST_CASE(node_derivative) {
+  // the derivative follows the moving average of the changes in the mean,
+  // however small they get
+  mcts::Node node;
+  double mean = mcts::draw_value, derivative = 0;
+  for (unsigned i = 1; i <= 10000; i++) {
+    double result = i % 3 ? mcts::win_value : mcts::loss_value;
+    double mean0 = mean;
+    mean += (result - mean) / i;
+    derivative = 0.9*derivative + 0.1*(mean - mean0);
+    node.update(result);
+  }
+  BOOST_CHECK_LT(std::abs(derivative), 1e-4);
+  BOOST_CHECK_CLOSE(node.derivative(), derivative, 1);
+}
+
+BOOST_AUTO_TEST_CASE(node_virtual_loss) {
+  mcts::Node node;
+  for (int i = 0; i < 20; i++)
+    node.update(i % 2 ? mcts::win_value : mcts::draw_value);
+  auto criterion = [&node](mcts::VirtualLoss const& virtual_loss) {
+    // same noise every time
+    boost::mt19937 generator;
+    return mcts::policies::Derivative().score(mcts::policies::Parent(20), node.estimate(virtual_loss), 0, generator);
+  };
+  mcts::VirtualLoss none(mcts::VirtualLoss::none),
+    pessimistic(mcts::VirtualLoss::pessimistic, 1),
+    constant(mcts::VirtualLoss::constant, 0.1);
+  double unloaded = criterion(none);
+  BOOST_CHECK_EQUAL(criterion(pessimistic), unloaded);
+
+  node.add_virtual_loss();
+  node.add_virtual_loss();
+  BOOST_CHECK_EQUAL(criterion(none), unloaded);
+  BOOST_CHECK_LT(criterion(pessimistic), unloaded);
+  BOOST_CHECK_CLOSE(criterion(constant), unloaded - 0.2, 1e-6);
+  BOOST_CHECK_EQUAL(node.effective_sample_size(none), 20);
+  BOOST_CHECK_EQUAL(node.effective_sample_size(pessimistic), 22);
+
+  node.remove_virtual_loss();
+  node.remove_virtual_loss();
+  BOOST_CHECK_EQUAL(criterion(pessimistic), unloaded);
+}
+
+BOOST_AUTO_TEST_CASE(node_table_replacement) {
+  std::unique_ptr<mcts::NodeTable> table(new mcts::NodeTable(16));
+  // same bucket, different positions
+  auto hash = [](Hash i) { return i << 40 | 0x1234; };
+  BOOST_CHECK(!table->probe(hash(1)));
+  for (Hash i = 0; i < 8; i++) {
+    mcts::Node* node = table->store(hash(i));
+    BOOST_CHECK_EQUAL(node->hash, hash(i));
+    for (Hash j = 0; j < i; j++)
+      node->update(mcts::win_value);
+  }
+  for (Hash i = 0; i < 8; i++)
+    BOOST_CHECK_EQUAL(table->probe(hash(i))->sample_size(), i);
+
+  // the bucket is full; the node with the fewest samples goes
+  BOOST_CHECK_EQUAL(table->store(hash(8))->sample_size(), 0);
+  BOOST_CHECK(!table->probe(hash(0)));
+  BOOST_CHECK(table->probe(hash(1)));
+
+  // after aging, nodes that haven't been used since go first
+  table->age();
+  for (Hash i = 1; i < 5; i++)
+    table->probe(hash(i));
+  table->probe(hash(8));
+  table->store(hash(9));
+  BOOST_CHECK(!table->probe(hash(5)));
+  for (Hash i: {1, 2, 3, 4, 6, 7, 8, 9})
+    BOOST_CHECK(table->probe(hash(i)));
+}
+
+BOOST_AUTO_TEST_CASE(node_table_parents) {
+  mcts::NodeTable table(16);
+  mcts::Node* node = table.store(1);
+  // each thread adjoins every parent, so they all race to adjoin each one
+  boost::thread_group threads;
+  for (unsigned i = 0; i < 4; i++) {
+    threads.create_thread([&table, node]() {
+        for (Hash parent = 2; parent < 1000; parent++)
+          table.adjoin_parent(node, parent);
+      });
+  }
+  threads.join_all();
+  sorted_vector<Hash> parents;
+  table.do_parents(node, [&](Hash parent) {
+      BOOST_CHECK(!parents.contains(parent));
+      parents.insert(parent);
+    });
+  BOOST_CHECK_EQUAL(parents.size(), 998);
+
+  // clearing the table drops all parent links
+  table.clear();
+  BOOST_CHECK_EQUAL(table.count_parents(table.store(1)), 0);
+}
+
+BOOST_AUTO_TEST_CASE(node_table_size) {
+  mcts::NodeTable table(16);
+  size_t capacity = table.capacity();
+  BOOST_CHECK_GT(capacity, 0);
+  BOOST_CHECK_LE(capacity * sizeof(mcts::Node), 16 << 20);
+  mcts::Node* node = table.store(1);
+  node->update(mcts::win_value);
+  table.adjoin_parent(node, 2);
+  table.resize(64);
+  BOOST_CHECK_EQUAL(table.capacity(), 4 * capacity);
+
+  // nodes in use survive resizing either way, with their parents
+  for (size_t megabytes: {64, 16}) {
+    table.resize(megabytes);
+    node = table.probe(1);
+    BOOST_REQUIRE(node);
+    BOOST_CHECK_EQUAL(node->sample_size(), 1);
+    BOOST_CHECK_EQUAL(node->mean(), mcts::win_value);
+    BOOST_CHECK_EQUAL(table.count_parents(node), 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(serialize_graph_into_other_size) {
+  State state;
+  boost::mt19937 generator;
+  mcts::Graph graph(64);
+  for (int i = 0; i < 100; i++)
+    graph.sample(state, generator);
+
+  std::stringstream stream;
+  {
+    boost::archive::binary_oarchive archive(stream);
+    archive << graph;
+  }
+  for (size_t megabytes: {16, 256}) {
+    stream.seekg(0);
+    mcts::Graph other(megabytes);
+    boost::archive::binary_iarchive archive(stream);
+    archive >> other;
+    std::stringstream expected, actual;
+    graph.print_statistics(expected, state);
+    other.print_statistics(actual, state);
+    BOOST_CHECK_EQUAL(expected.str(), actual.str());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(graph_expand) {
+  State state;
+  mcts::Graph graph(16);
+  mcts::Node* node = graph.node(state);
+  BOOST_REQUIRE(graph.expand(node, state));
+  BOOST_CHECK(node->expanded());
+  mcts::EdgeRange edges = graph.edges(node);
+  MoveList moves;
+  moves::legal_moves(moves, state);
+  BOOST_REQUIRE_EQUAL(edges.size(), moves.size());
+  for (size_t i = 0; i < moves.size(); i++) {
+    mcts::Edge const& edge = edges.begin()[i];
+    State successor(state);
+    successor.make_move(moves[i]);
+    BOOST_CHECK_EQUAL(edge.move, moves[i]);
+    BOOST_CHECK_EQUAL(edge.hash, successor.hash);
+    BOOST_CHECK_EQUAL(graph.node(successor)->hash, successor.hash);
+    BOOST_CHECK_CLOSE(edge.prior, 1.0 / moves.size(), 1e-3);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(expand_priors) {
+  // white can take the pawn on d5
+  State state("rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2");
+  mcts::Graph graph(16);
+  mcts::Node* node = graph.node(state);
+  BOOST_REQUIRE(graph.expand(node, state));
+  double total = 0, capture = 0, quiet = 0;
+  for (mcts::Edge const& edge: graph.edges(node)) {
+    total += edge.prior;
+    (edge.move.is_capture() ? capture : quiet) = edge.prior;
+  }
+  BOOST_CHECK_CLOSE(total, 1, 1e-3);
+  BOOST_CHECK_GT(capture, quiet);
+}
+
+BOOST_AUTO_TEST_CASE(progressive_widening) {
+  // white can take the pawn on e5
+  State state("rnbqkb1r/pppp1ppp/5n2/4p3/4P3/3P1N2/PPP2PPP/RNBQKB1R w KQkq - 1 4");
+  boost::mt19937 generator;
+  mcts::Graph graph(16);
+  graph.selection_mode = mcts::selection_uct;
+  mcts::Node* root = graph.node(state);
+  BOOST_REQUIRE(graph.expand(root, state));
+  mcts::EdgeRange edges = graph.edges(root);
+  for (size_t i = 1; i < edges.size(); i++)
+    BOOST_CHECK_GE(edges.begin()[i - 1].prior, edges.begin()[i].prior);
+  BOOST_CHECK(edges.begin()[0].move.is_capture());
+
+  const size_t nsamples = 50;
+  for (size_t i = 0; i < nsamples; i++)
+    graph.sample(state, generator);
+  // the root had nsamples - 1 samples when the last one was selected
+  size_t width = graph.widening.width(nsamples - 1);
+  BOOST_REQUIRE_LT(width, edges.size());
+  for (size_t i = 0; i < edges.size(); i++) {
+    State successor(state);
+    successor.make_move(edges.begin()[i].move);
+    if (i < width)
+      BOOST_CHECK_GT(graph.node(successor)->sample_size(), 0);
+    else
+      BOOST_CHECK_EQUAL(graph.node(successor)->sample_size(), 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(selection_policies) {
+  State state;
+  for (mcts::SelectionMode mode: {mcts::selection_derivative, mcts::selection_uct,
+                                  mcts::selection_ucb1_tuned, mcts::selection_puct}) {
+    boost::mt19937 generator;
+    mcts::Graph graph(16);
+    graph.selection_mode = mode;
+    for (int i = 0; i < 200; i++)
+      graph.sample(state, generator);
+    mcts::Node* root = graph.node(state);
+    BOOST_CHECK_EQUAL(root->sample_size(), 200);
+    if (mode == mcts::selection_uct || mode == mcts::selection_ucb1_tuned) {
+      // every child is tried before any is tried twice, once it is among
+      // the candidates
+      BOOST_REQUIRE(root->expanded());
+      mcts::EdgeRange edges = graph.edges(root);
+      edges.count = graph.widening.width(100);
+      for (mcts::Edge const& edge: edges) {
+        State successor(state);
+        successor.make_move(edge.move);
+        BOOST_CHECK_GE(graph.node(successor)->sample_size(), 1);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(rave) {
+  mcts::Rave rave(true, 100);
+  uint64_t amaf = mcts::Node::pack_statistics(10, mcts::win_value);
+  mcts::Estimate fresh{0, mcts::draw_value, 0, 0}, seasoned{100, mcts::draw_value, 0, 0};
+  rave.blend(fresh, amaf);
+  rave.blend(seasoned, amaf);
+  BOOST_CHECK_CLOSE(fresh.mean, mcts::win_value, 1e-6);
+  BOOST_CHECK_CLOSE(seasoned.mean, 0.75, 1e-6);
+
+  State state;
+  boost::mt19937 generator;
+  mcts::Graph graph(16);
+  graph.selection_mode = mcts::selection_uct;
+  graph.rave.enabled = true;
+  for (int i = 0; i < 200; i++)
+    graph.sample(state, generator);
+  mcts::Node* root = graph.node(state);
+  BOOST_REQUIRE(root->expanded());
+  // moves are credited at most once per sample, and on the whole far more
+  // often than they are selected
+  double total = 0;
+  for (mcts::Edge const& edge: graph.edges(root)) {
+    uint32_t sample_size = mcts::Node::unpack_sample_size(graph.amaf(edge));
+    BOOST_CHECK_LE(sample_size, 200);
+    total += sample_size;
+  }
+  BOOST_CHECK_GT(total, 2 * 200);
+}
+
+BOOST_AUTO_TEST_CASE(collect_garbage) {
+  State state;
+  boost::mt19937 generator;
+  mcts::Graph graph(16);
+  graph.selection_mode = mcts::selection_uct;
+  for (int i = 0; i < 500; i++)
+    graph.sample(state, generator);
+
+  mcts::Node* root = graph.node(state);
+  BOOST_REQUIRE(root->expanded());
+  // a pawn move, so that there is no way back to where it came from
+  mcts::Edge const& edge = *std::find_if(graph.edges(root).begin(), graph.edges(root).end(), [](mcts::Edge const& edge) {
+      return edge.move.type() == move_types::double_push;
+    });
+  State successor(state);
+  successor.make_move(edge.move);
+  mcts::Node* child = graph.node(successor);
+  double sample_size = child->sample_size(), mean = child->mean();
+  size_t nedges = child->expanded() ? graph.edges(child).size() : 0;
+
+  size_t kept = graph.collect(successor);
+  BOOST_CHECK_GT(kept, 0);
+  BOOST_CHECK_LT(kept, graph.expansions());
+  // the subgraph survives, with its edges and parents, and the rest is gone
+  child = graph.node(successor);
+  BOOST_CHECK_EQUAL(child->sample_size(), sample_size);
+  BOOST_CHECK_EQUAL(child->mean(), mean);
+  BOOST_CHECK_EQUAL(child->expanded() ? graph.edges(child).size() : 0, nedges);
+  for (mcts::Edge const& edge: graph.edges(child)) {
+    State grandchild(successor);
+    grandchild.make_move(edge.move);
+    BOOST_CHECK_EQUAL(edge.hash, grandchild.hash);
+  }
+  BOOST_CHECK_EQUAL(graph.node(state)->sample_size(), 0);
+
+  // and sampling carries on from there, through the compacted parent lists
+  graph.backprop_mode = mcts::backprop_ancestors;
+  for (int i = 0; i < 100; i++)
+    graph.sample(successor, generator);
+  BOOST_CHECK_EQUAL(graph.node(successor)->sample_size(), sample_size + 100);
+}
+
+BOOST_AUTO_TEST_CASE(graph_merge) {
+  State state;
+  std::vector<std::unique_ptr<mcts::Graph> > graphs;
+  std::vector<mcts::Graph*> sources;
+  for (unsigned i = 0; i < 2; i++) {
+    boost::mt19937 generator(i);
+    graphs.emplace_back(new mcts::Graph(16));
+    for (unsigned j = 0; j < 100 * (i + 1); j++)
+      graphs.back()->sample(state, generator);
+    sources.push_back(graphs.back().get());
+  }
+
+  mcts::Graph combined(16);
+  combined.merge(sources, state, 1);
+  BOOST_CHECK_EQUAL(combined.node(state)->sample_size(), 300);
+  graphs[0]->node(state)->do_successors(state, [&](State const& successor, Move move) {
+      mcts::Node *a = graphs[0]->node(successor), *b = graphs[1]->node(successor);
+      double sample_size = a->sample_size() + b->sample_size();
+      mcts::Node* merged = combined.node(successor);
+      BOOST_CHECK_EQUAL(merged->sample_size(), sample_size);
+      if (sample_size > 0)
+        BOOST_CHECK_CLOSE(merged->mean(), (a->sample_size()*a->mean() + b->sample_size()*b->mean()) / sample_size, 1e-6);
+    });
+
+  // what the sources no longer have is not kept from earlier merges
+  mcts::Graph empty(16);
+  combined.merge(std::vector<mcts::Graph*>{&empty}, state, 1);
+  BOOST_CHECK_EQUAL(combined.node(state)->sample_size(), 0);
+  combined.node(state)->do_successors(state, [&](State const& successor, Move move) {
+      BOOST_CHECK_EQUAL(combined.node(successor)->sample_size(), 0);
+    });
+}
+
+BOOST_AUTO_TEST_CASE(playout_pool) {
+  boost::mt19937 generator, untouched;
+  PlayoutPool pool(3, generator);
+  // the workers' seeds are drawn from the caller's generator, so that
+  // pools made with different generators don't play the same playouts
+  BOOST_CHECK(generator != untouched);
+  std::atomic<unsigned> count(0);
+  PlayoutPool::Playout playout = [&count](boost::mt19937& generator) {
+    count++;
+    return 0.5;
+  };
+  // batches from several callers at once
+  boost::thread_group callers;
+  std::atomic<unsigned> mismatches(0);
+  for (unsigned i = 0; i < 4; i++) {
+    callers.create_thread([&, i]() {
+        boost::mt19937 generator(i);
+        for (unsigned j = 0; j < 100; j++)
+          if (pool.total(j % 8, playout, generator) != 0.5 * (j % 8))
+            mismatches++;
+      });
+  }
+  callers.join_all();
+  BOOST_CHECK_EQUAL(mismatches, 0);
+  // j % 8 summed over j < 100
+  BOOST_CHECK_EQUAL(count, 4 * (12 * 28 + 6));
+}
+
+BOOST_AUTO_TEST_CASE(leaf_parallel_sampling) {
+  State state;
+  boost::mt19937 generator;
+  mcts::Graph graph(16);
+  graph.set_leaf_parallelism(4, 2, generator);
+  for (int i = 0; i < 100; i++)
+    graph.sample(state, generator);
+  // one update per sample, however many playouts
+  BOOST_CHECK_EQUAL(graph.node(state)->sample_size(), 100);
+
+  // graphs sampling at once on one pool
+  std::shared_ptr<PlayoutPool> pool = std::make_shared<PlayoutPool>(2, generator);
+  std::vector<std::unique_ptr<mcts::Graph> > graphs;
+  boost::thread_group samplers;
+  for (unsigned i = 0; i < 2; i++) {
+    graphs.emplace_back(new mcts::Graph(16));
+    graphs.back()->set_leaf_parallelism(4, pool);
+    mcts::Graph* graph = graphs.back().get();
+    samplers.create_thread([graph, &state, i]() {
+        boost::mt19937 generator(i);
+        for (int j = 0; j < 100; j++)
+          graph->sample(state, generator);
+      });
+  }
+  samplers.join_all();
+  for (auto& graph: graphs)
+    BOOST_CHECK_EQUAL(graph->node(state)->sample_size(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(backprop_path) {
+  State state;
+  boost::mt19937 generator;
+  mcts::Graph graph(64);
+  graph.backprop_mode = mcts::backprop_path_aggregated;
+  for (int i = 0; i < 100; i++)
+    graph.sample(state, generator);
+  // exactly one update per sample, as the root is on every path
+  mcts::Node* root = graph.node(state);
+  BOOST_CHECK_EQUAL(root->sample_size(), 100);
+
+  // the root is expanded by now, and its mean is that of its children
+  BOOST_REQUIRE(root->expanded());
+  double sample_size = 0, total = 0;
+  for (mcts::Edge const& edge: graph.edges(root)) {
+    State successor(state);
+    successor.make_move(edge.move);
+    mcts::Node* child = graph.node(successor);
+    sample_size += child->sample_size();
+    total += child->sample_size() * child->mean();
+  }
+  BOOST_CHECK_CLOSE(root->mean(), mcts::invert_result(total / sample_size), 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(rollout) {
+  boost::mt19937 generator;
+  mcts::Graph graph(16);
+  // fool's mate; white to move and checkmated
+  State mated("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3");
+  BOOST_CHECK_EQUAL(graph.rollout(mated, generator), mcts::loss_value);
+  // bare kings are drawn eventually
+  State bare("8/8/4k3/8/8/3K4/8/8 w - - 0 1");
+  BOOST_CHECK_EQUAL(graph.rollout(bare, generator), mcts::draw_value);
+}
+
+BOOST_AUTO_TEST_CASE(rollout_cutoff) {
+  boost::mt19937 generator;
+  mcts::Graph graph(16);
+  // white is a queen up, which is decisive right away
+  State white_ahead("rnb1kbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 3");
+  double expected = graph.cutoff.adjudicate(9);
+  BOOST_CHECK_GT(expected, 0.95);
+  BOOST_CHECK_CLOSE(graph.rollout(white_ahead, generator), expected, 1e-6);
+  State black_behind("rnb1kbnr/pppp1ppp/8/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R b KQkq - 1 3");
+  BOOST_CHECK_CLOSE(graph.rollout(black_behind, generator), mcts::invert_result(expected), 1e-6);
+
+  // equal material at the ply limit is a draw
+  graph.cutoff.max_plies = 0;
+  BOOST_CHECK_EQUAL(graph.rollout(State(), generator), mcts::draw_value);
+
+  // without the cutoff, the game is played to the end
+  graph.cutoff.enabled = false;
+  double result = graph.rollout(white_ahead, generator);
+  BOOST_CHECK(result == mcts::win_value || result == mcts::draw_value || result == mcts::loss_value);
+}
+
+BOOST_AUTO_TEST_CASE(sample_expansion) {
+  // samples add a node each, plus the children of nodes that get expanded,
+  // rather than a node for every position of the playout
+  State state;
+  boost::mt19937 generator;
+  mcts::Graph graph(64);
+  for (int i = 0; i < 300; i++)
+    graph.sample(state, generator);
+  BOOST_CHECK_LE(graph.expansions(), 3 * 300);
+  BOOST_CHECK_EQUAL(graph.node(state)->sample_size(), 300);
+}
+
 BOOST_AUTO_TEST_CASE(mcts_endgame_graphviz) {
   return;
   State state("r1bk3r/p2p1pNp/n2B1n2/1p1NP2P/6P1/3P4/P1P1K3/q5b1 w - - 0 23");
@@ -0,0 +1,96 @@
+#include <ctime>
+#include <memory>
+#include <iostream>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "mcts.hpp"
+
+#define fmt boost::format
+
+// plays the selection policies against each other to compare their strength
+// per CPU-second: each side samples single-threaded for the same CPU time per
+// move, so that a policy that selects faster gets more samples.
+//
+// usage: tournament [milliseconds per move] [games per pairing] [megabytes per graph]
+
+struct Player {
+  std::string name;
+  mcts::SelectionMode mode;
+};
+
+const Player players[] = {
+  {"derivative", mcts::selection_derivative},
+  {"uct",        mcts::selection_uct},
+  {"ucb1-tuned", mcts::selection_ucb1_tuned},
+  {"puct",       mcts::selection_puct},
+};
+const size_t nplayers = sizeof(players) / sizeof(Player);
+
+// games that go on this long are called a draw
+const unsigned max_plies = 300;
+
+Move choose_move(mcts::Graph& graph, State const& state, double milliseconds, boost::mt19937& generator) {
+  std::clock_t deadline = std::clock() + std::clock_t(milliseconds / 1e3 * CLOCKS_PER_SEC);
+  // at least one sample, so that there is something to choose from
+  do {
+    graph.sample(state, generator);
+  } while (std::clock() < deadline);
+  return *graph.principal_move(state);
+}
+
+// the result from white's perspective
+double play(Player const& white, Player const& black, double milliseconds, size_t megabytes, boost::mt19937& generator) {
+  std::unique_ptr<mcts::Graph> graphs[colors::cardinality];
+  for (Color color: colors::values) {
+    graphs[color].reset(new mcts::Graph(megabytes));
+    graphs[color]->selection_mode = (color == colors::white ? white : black).mode;
+  }
+
+  State state;
+  for (unsigned ply = 0; ply < max_plies; ply++) {
+    if (state.game_over()) {
+      boost::optional<Color> winner = state.winner();
+      return !winner
+        ? mcts::draw_value
+        : (*winner == colors::white
+           ? mcts::win_value
+           : mcts::loss_value);
+    }
+    state.make_move(choose_move(*graphs[state.us], state, milliseconds, generator));
+  }
+  return mcts::draw_value;
+}
+
+int main(int argc, char* argv[]) {
+  double milliseconds = argc > 1 ? boost::lexical_cast<double>(argv[1]) : 100;
+  unsigned ngames = argc > 2 ? boost::lexical_cast<unsigned>(argv[2]) : 10;
+  size_t megabytes = argc > 3 ? boost::lexical_cast<size_t>(argv[3]) : 64;
+
+  boost::mt19937 generator;
+  double scores[nplayers] = {0};
+  unsigned games[nplayers] = {0};
+
+  std::cout << fmt("%1% ms per move, %2% games per pairing") % milliseconds % ngames << std::endl;
+  for (size_t i = 0; i < nplayers; i++) {
+    for (size_t j = i + 1; j < nplayers; j++) {
+      double score = 0;
+      for (unsigned game = 0; game < ngames; game++) {
+        // alternate colors
+        double result = game % 2 == 0
+          ? play(players[i], players[j], milliseconds, megabytes, generator)
+          : mcts::invert_result(play(players[j], players[i], milliseconds, megabytes, generator));
+        score += result;
+      }
+      scores[i] += score;
+      scores[j] += ngames - score;
+      games[i] += ngames;
+      games[j] += ngames;
+      std::cout << fmt("%1% vs %2%: %3%-%4%") % players[i].name % players[j].name % score % (ngames - score) << std::endl;
+    }
+  }
+
+  std::cout << std::endl;
+  for (size_t i = 0; i < nplayers; i++)
+    std::cout << fmt("%1% %2%/%3%") % players[i].name % scores[i] % games[i] << std::endl;
+}
@@ -1,12 +1,16 @@
-// ideally cheap to construct, possibly expensive to apply
+// cheap to construct and to apply
 struct Undo {
   Move move;
-  size_t prior_halfmove_clock;
+  uint16_t prior_halfmove_clock;
   Bitboard prior_en_passant_square;
   CastlingRights prior_castling_rights;
   Piece captured_piece;
   Bitboard capture_square;
 
+  // redundant state is restored wholesale rather than recomputed
+  Hash prior_hash;
+  Bitboard prior_flat_occupancy;
+
   inline void record_capture(Piece piece, Bitboard square) {
     captured_piece = piece;
     capture_square = square;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <cassert>
 #include <fstream>
 
 #include <boost/random.hpp>
@@ -21,10 +23,11 @@ void dump_for_debug(State state, std::vector<Move> moves);
 
 std::vector<std::string> words(std::string string);
 
-template <typename T>
-T random_element(std::vector<T> const& elements, boost::mt19937& generator) {
+template <typename Container>
+typename Container::value_type random_element(Container const& elements, boost::mt19937& generator) {
+  assert(!elements.empty());
   boost::uniform_int<> distribution(0, elements.size() - 1);
-  return elements.at(distribution(generator));
+  return *(elements.begin() + distribution(generator));
 }
 
 extern boost::normal_distribution<double> standard_normal_distribution;